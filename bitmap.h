@@ -1,3 +1,6 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
 #include <cstring>
 #include <string>
 #include <cstdlib>
@@ -9,7 +12,7 @@ struct rgb_t {
 	char b;
 };
 
-void  write_bitmap(std::string fn, rgb_t * data, unsigned int w, unsigned int h) {
+inline void write_bitmap(std::string fn, rgb_t * data, unsigned int w, unsigned int h) {
 	FILE *f;
 	unsigned char *img = NULL;
 	int filesize = 54 + 3*w*h;  //w is your image width, h is image height, both int
@@ -17,9 +20,9 @@ void  write_bitmap(std::string fn, rgb_t * data, unsigned int w, unsigned int h)
 	img = (unsigned char *)malloc(3*w*h);
 	memset(img,0,3*w*h);
 
-	for(int i=0; i<w; i++)
+	for(unsigned int i=0; i<w; i++)
 	{
-		for(int j=0; j<h; j++)
+		for(unsigned int j=0; j<h; j++)
 		{
 			int x=i; int y=(h-1)-j;
 			//r = red[i][j]*255;
@@ -56,7 +59,7 @@ void  write_bitmap(std::string fn, rgb_t * data, unsigned int w, unsigned int h)
 	f = fopen(fn.c_str(),"wb");
 	fwrite(bmpfileheader,1,14,f);
 	fwrite(bmpinfoheader,1,40,f);
-	for(int i=0; i<h; i++)
+	for(unsigned int i=0; i<h; i++)
 	{
 		fwrite(img+(w*(h-i-1)*3),3,w,f);
 		fwrite(bmppad,1,(4-(w*3)%4)%4,f);
@@ -64,4 +67,58 @@ void  write_bitmap(std::string fn, rgb_t * data, unsigned int w, unsigned int h)
 
 	free(img);
 	fclose(f);
-}
\ No newline at end of file
+}
+
+// streaming writer for images too big to hold in memory. the header is
+// written up front with a negative height (top-down bitmap) so rows go to
+// disk first to last, top to bottom, as soon as they are made.
+struct bitmap_stream_t {
+	FILE * f;
+	unsigned int w;
+	unsigned int h;
+};
+
+inline bool bitmap_begin(bitmap_stream_t & bs, std::string fn, unsigned int w, unsigned int h) {
+	unsigned int row = (3*w + 3) & ~3u; // rows are padded to 4 bytes
+	unsigned int filesize = 54 + row*h; // wraps past 4GB, most readers only use w and h
+	unsigned int nh = -h;
+
+	unsigned char bmpfileheader[14] = {'B','M', 0,0,0,0, 0,0, 0,0, 54,0,0,0};
+	unsigned char bmpinfoheader[40] = {40,0,0,0, 0,0,0,0, 0,0,0,0, 1,0, 24,0};
+
+	bmpfileheader[ 2] = (unsigned char)(filesize    );
+	bmpfileheader[ 3] = (unsigned char)(filesize>> 8);
+	bmpfileheader[ 4] = (unsigned char)(filesize>>16);
+	bmpfileheader[ 5] = (unsigned char)(filesize>>24);
+
+	bmpinfoheader[ 4] = (unsigned char)(       w    );
+	bmpinfoheader[ 5] = (unsigned char)(       w>> 8);
+	bmpinfoheader[ 6] = (unsigned char)(       w>>16);
+	bmpinfoheader[ 7] = (unsigned char)(       w>>24);
+	bmpinfoheader[ 8] = (unsigned char)(      nh    );
+	bmpinfoheader[ 9] = (unsigned char)(      nh>> 8);
+	bmpinfoheader[10] = (unsigned char)(      nh>>16);
+	bmpinfoheader[11] = (unsigned char)(      nh>>24);
+
+	bs.f = fopen(fn.c_str(),"wb");
+	bs.w = w;
+	bs.h = h;
+	if (bs.f == NULL) return false;
+	fwrite(bmpfileheader,1,14,bs.f);
+	fwrite(bmpinfoheader,1,40,bs.f);
+	return true;
+}
+
+// write the next row. bgr is w pixels already in file order (b, g, r)
+inline void bitmap_write_row(bitmap_stream_t & bs, const unsigned char * bgr) {
+	unsigned char bmppad[3] = {0,0,0};
+	fwrite(bgr,3,bs.w,bs.f);
+	fwrite(bmppad,1,(4-(bs.w*3)%4)%4,bs.f);
+}
+
+inline void bitmap_end(bitmap_stream_t & bs) {
+	fclose(bs.f);
+	bs.f = NULL;
+}
+
+#endif // BITMAP_H
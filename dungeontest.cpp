@@ -21,36 +21,146 @@ namespace patch
 #include <time.h> // time()
 #include <math.h> // sin/cos
 #include <cstring> // memcpy
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #define PI 3.14159265359
 
 const int param_n_rooms = 50;
 const int param_radius = 20; 
-const int param_height = 100;
-const int param_width = 100;
+const float param_gap = 1; // separated rooms are at least this far apart
+const float param_fill = 0.6; // share of the start circle rooms may cover before it is spread
+const float param_loops = 0.15; // share of the non tree delaunay edges kept as loops
+const int param_corridor = 3; // corridor width in tiles
 
 int global_uuid_idx = 0;
 
+// room geometry lives in room_geom_t, this is everything else about a room
 struct room_t {
 	int id_self;
-	float x;
-	float y;
-	int w;
-	int h;
 	bool fixed;
 	
 	// neighbors
 	int n1;
 	int n2;
 	int n3;
-	
-	
-	void get_center(int &xf, int &yf){
-		xf = (x + w) / 2;
-		yf = (y + h) / 2;
+};
+
+// room geometry as a structure of arrays, room i at x[i], y[i], w[i], h[i].
+// the overlap kernels read 8 rooms from each array at a time, so the arrays
+// are padded to a multiple of ROOM_BLOCK with far away empty rooms that
+// overlap nothing. sizes are whole tiles, kept as floats for the kernels
+const int ROOM_BLOCK = 8;
+
+struct room_geom_t {
+	int n;
+	float * x;
+	float * y;
+	float * w;
+	float * h;
+};
+
+const float ROOM_NOWHERE = FLT_MAX / 4; // x and y of the padding rooms
+
+void geom_init(room_geom_t & g, int n) {
+	int cap = (n + ROOM_BLOCK - 1) / ROOM_BLOCK * ROOM_BLOCK;
+	g.n = n;
+	g.x = new float[4 * std::max(cap, ROOM_BLOCK)];
+	g.y = g.x + cap;
+	g.w = g.y + cap;
+	g.h = g.w + cap;
+	for (int i = n; i < cap; i++) {
+		g.x[i] = g.y[i] = ROOM_NOWHERE;
+		g.w[i] = g.h[i] = 0;
+	}
+}
+
+void geom_free(room_geom_t & g) {
+	delete[] g.x;
+	g.x = g.y = g.w = g.h = NULL;
+}
+
+// the kernels. bit i of the result is set when the query room, already
+// grown by param_gap on every side as (qx0, qy0) - (qx1, qy1), overlaps
+// room i of the 8 starting at x, y, w, h. or for size_mask8, when room i
+// is bigger than min_w x min_h. the portable ones are plain loops; on
+// x86-64 SSE2 is always there and does 4 rooms per compare, and the AVX
+// ones do all 8 and are used when the cpu has AVX
+struct room_kernel_t {
+	static inline unsigned overlap_mask8(const float * x, const float * y, const float * w,
+			const float * h, float qx0, float qy0, float qx1, float qy1) {
+		unsigned m = 0;
+		for (int i = 0; i < ROOM_BLOCK; i++)
+			m |= (unsigned) (qx0 < x[i] + w[i] && x[i] < qx1 && qy0 < y[i] + h[i] && y[i] < qy1) << i;
+		return m;
+	}
+
+	static inline unsigned size_mask8(const float * w, const float * h, float min_w, float min_h) {
+		unsigned m = 0;
+		for (int i = 0; i < ROOM_BLOCK; i++)
+			m |= (unsigned) (w[i] > min_w && h[i] > min_h) << i;
+		return m;
 	}
 };
 
+#if defined(__x86_64__)
+struct room_kernel_sse_t {
+	static inline unsigned overlap4(const float * x, const float * y, const float * w,
+			const float * h, __m128 qx0, __m128 qy0, __m128 qx1, __m128 qy1) {
+		__m128 bx = _mm_loadu_ps(x);
+		__m128 by = _mm_loadu_ps(y);
+		__m128 c = _mm_and_ps(_mm_cmplt_ps(qx0, _mm_add_ps(bx, _mm_loadu_ps(w))), _mm_cmplt_ps(bx, qx1));
+		c = _mm_and_ps(c, _mm_cmplt_ps(qy0, _mm_add_ps(by, _mm_loadu_ps(h))));
+		c = _mm_and_ps(c, _mm_cmplt_ps(by, qy1));
+		return _mm_movemask_ps(c);
+	}
+
+	static inline unsigned overlap_mask8(const float * x, const float * y, const float * w,
+			const float * h, float qx0, float qy0, float qx1, float qy1) {
+		__m128 x0 = _mm_set1_ps(qx0);
+		__m128 y0 = _mm_set1_ps(qy0);
+		__m128 x1 = _mm_set1_ps(qx1);
+		__m128 y1 = _mm_set1_ps(qy1);
+		return overlap4(x, y, w, h, x0, y0, x1, y1) | overlap4(x + 4, y + 4, w + 4, h + 4, x0, y0, x1, y1) << 4;
+	}
+
+	static inline unsigned size_mask8(const float * w, const float * h, float min_w, float min_h) {
+		__m128 mw = _mm_set1_ps(min_w);
+		__m128 mh = _mm_set1_ps(min_h);
+		unsigned lo = _mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(_mm_loadu_ps(w), mw), _mm_cmpgt_ps(_mm_loadu_ps(h), mh)));
+		unsigned hi = _mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(_mm_loadu_ps(w + 4), mw), _mm_cmpgt_ps(_mm_loadu_ps(h + 4), mh)));
+		return lo | hi << 4;
+	}
+};
+
+struct room_kernel_avx_t {
+	__attribute__((target("avx"))) static inline unsigned overlap_mask8(const float * x, const float * y,
+			const float * w, const float * h, float qx0, float qy0, float qx1, float qy1) {
+		__m256 bx = _mm256_loadu_ps(x);
+		__m256 by = _mm256_loadu_ps(y);
+		__m256 c = _mm256_and_ps(_mm256_cmp_ps(_mm256_set1_ps(qx0), _mm256_add_ps(bx, _mm256_loadu_ps(w)), _CMP_LT_OQ),
+			_mm256_cmp_ps(bx, _mm256_set1_ps(qx1), _CMP_LT_OQ));
+		c = _mm256_and_ps(c, _mm256_cmp_ps(_mm256_set1_ps(qy0), _mm256_add_ps(by, _mm256_loadu_ps(h)), _CMP_LT_OQ));
+		c = _mm256_and_ps(c, _mm256_cmp_ps(by, _mm256_set1_ps(qy1), _CMP_LT_OQ));
+		return _mm256_movemask_ps(c);
+	}
+
+	__attribute__((target("avx"))) static inline unsigned size_mask8(const float * w, const float * h,
+			float min_w, float min_h) {
+		__m256 c = _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(w), _mm256_set1_ps(min_w), _CMP_GT_OQ),
+			_mm256_cmp_ps(_mm256_loadu_ps(h), _mm256_set1_ps(min_h), _CMP_GT_OQ));
+		return _mm256_movemask_ps(c);
+	}
+};
+#endif
+
 struct graph_node_t {
 	int id_self;
 	int id_target;
@@ -104,26 +214,976 @@ double rand_normal(double mean, double stddev) {//Box muller method
     }
 }
 
-int main() {
-	srand(time(NULL)); // init random
-	
-	int x_min = -1;
-	int y_min = -1;
+// uniform grid broad phase over the rooms placed so far. cells are at least
+// as big as any room, so a room sits in at most 2x2 of them and a query only
+// looks at the few cells around it. cells are hashed since rooms spread
+// out as far as separation pushes them. a cell is a list of chunks, each a
+// copy of the geometry of up to ROOM_BLOCK of its rooms laid out like
+// room_geom_t, so one kernel call tests a query against a whole chunk
+struct room_chunk_t {
+	float x[ROOM_BLOCK];
+	float y[ROOM_BLOCK];
+	float w[ROOM_BLOCK];
+	float h[ROOM_BLOCK];
+	int room[ROOM_BLOCK];
+	int used;
+	int next; // next chunk of the same cell, -1 at the end
+};
 
-	// generate list of n rooms within a circle of radius r using normal distrib for size
-	room_t* rooms = new room_t[param_n_rooms];
-	for (int i = 0; i < param_n_rooms; i++){
+struct room_hash_t {
+	float cell;
+	std::unordered_map<uint64_t, int> head; // cell key -> newest chunk
+	std::vector<room_chunk_t> chunks;
+};
+
+static inline uint64_t cell_key(int cx, int cy) {
+	return ((uint64_t) (uint32_t) cx << 32) | (uint32_t) cy;
+}
+
+static inline int cell_of(const room_hash_t & hs, float v) {
+	return (int) floorf(v / hs.cell);
+}
+
+void room_hash_init(room_hash_t & hs, const room_geom_t & g) {
+	float side = 1;
+	for (int i = 0; i < g.n; i++)
+		side = std::max(side, std::max(g.w[i], g.h[i]));
+	hs.cell = side + param_gap;
+	hs.head.clear();
+	hs.head.reserve(4 * g.n);
+	hs.chunks.clear();
+	hs.chunks.reserve(g.n);
+}
+
+void room_hash_insert(room_hash_t & hs, const room_geom_t & g, int i) {
+	for (int cy = cell_of(hs, g.y[i]); cy <= cell_of(hs, g.y[i] + g.h[i]); cy++) {
+		for (int cx = cell_of(hs, g.x[i]); cx <= cell_of(hs, g.x[i] + g.w[i]); cx++) {
+			std::pair<std::unordered_map<uint64_t, int>::iterator, bool> it =
+				hs.head.insert(std::make_pair(cell_key(cx, cy), -1));
+			int c = it.first->second;
+			if (c < 0 || hs.chunks[c].used == ROOM_BLOCK) {
+				room_chunk_t ch;
+				for (int k = 0; k < ROOM_BLOCK; k++) {
+					ch.x[k] = ch.y[k] = ROOM_NOWHERE;
+					ch.w[k] = ch.h[k] = 0;
+				}
+				ch.used = 0;
+				ch.next = c;
+				hs.chunks.push_back(ch);
+				c = it.first->second = (int) hs.chunks.size() - 1;
+			}
+			room_chunk_t & ch = hs.chunks[c];
+			ch.x[ch.used] = g.x[i];
+			ch.y[ch.used] = g.y[i];
+			ch.w[ch.used] = g.w[i];
+			ch.h[ch.used] = g.h[i];
+			ch.room[ch.used++] = i;
+		}
+	}
+}
+
+// the first placed room found that room i is closer than param_gap to on
+// both axes, -1 if there is none. cells are scanned row by row, and each
+// cell newest room first, so this is the newest hit in the first cell that
+// has one, not the newest hit overall. separate_rooms picks its push axis
+// from whichever room this is
+template <class K> static inline int room_hash_overlap(const room_hash_t & hs, const room_geom_t & g, int i) {
+	float qx0 = g.x[i] - param_gap;
+	float qy0 = g.y[i] - param_gap;
+	float qx1 = g.x[i] + g.w[i] + param_gap;
+	float qy1 = g.y[i] + g.h[i] + param_gap;
+	for (int cy = cell_of(hs, qy0); cy <= cell_of(hs, qy1); cy++) {
+		for (int cx = cell_of(hs, qx0); cx <= cell_of(hs, qx1); cx++) {
+			std::unordered_map<uint64_t, int>::const_iterator it = hs.head.find(cell_key(cx, cy));
+			if (it == hs.head.end()) continue;
+			for (int c = it->second; c >= 0; c = hs.chunks[c].next) {
+				const room_chunk_t & ch = hs.chunks[c];
+				unsigned m = K::overlap_mask8(ch.x, ch.y, ch.w, ch.h, qx0, qy0, qx1, qy1);
+				if (m != 0) return ch.room[31 - __builtin_clz(m)]; // newest in the chunk
+			}
+		}
+	}
+	return -1;
+}
+
+// indices of the rooms bigger than min_w x min_h, in order
+template <class K> static inline int filter_rooms(const room_geom_t & g, float min_w, float min_h, int * out) {
+	int n = 0;
+	for (int b = 0; b < g.n; b += ROOM_BLOCK) {
+		unsigned m = K::size_mask8(g.w + b, g.h + b, min_w, min_h);
+		for (; m != 0; m &= m - 1) {
+			int i = b + __builtin_ctz(m);
+			if (i < g.n) out[n++] = i;
+		}
+	}
+	return n;
+}
+
+typedef int (*room_overlap_fn)(const room_hash_t & hs, const room_geom_t & g, int i);
+typedef int (*room_filter_fn)(const room_geom_t & g, float min_w, float min_h, int * out);
+
+// the kernel instances. the avx ones are flattened so the target("avx")
+// kernels can inline into them
+#if defined(__x86_64__)
+__attribute__((target("avx"), flatten)) int room_overlap_avx(const room_hash_t & hs, const room_geom_t & g, int i) {
+	return room_hash_overlap<room_kernel_avx_t>(hs, g, i);
+}
+
+__attribute__((target("avx"), flatten)) int room_filter_avx(const room_geom_t & g, float min_w, float min_h, int * out) {
+	return filter_rooms<room_kernel_avx_t>(g, min_w, min_h, out);
+}
+
+int room_overlap_sse(const room_hash_t & hs, const room_geom_t & g, int i) {
+	return room_hash_overlap<room_kernel_sse_t>(hs, g, i);
+}
+
+int room_filter_sse(const room_geom_t & g, float min_w, float min_h, int * out) {
+	return filter_rooms<room_kernel_sse_t>(g, min_w, min_h, out);
+}
+#else
+int room_overlap_plain(const room_hash_t & hs, const room_geom_t & g, int i) {
+	return room_hash_overlap<room_kernel_t>(hs, g, i);
+}
+
+int room_filter_plain(const room_geom_t & g, float min_w, float min_h, int * out) {
+	return filter_rooms<room_kernel_t>(g, min_w, min_h, out);
+}
+#endif
+
+// the best kernels this cpu runs
+room_overlap_fn pick_overlap() {
+#if defined(__x86_64__)
+	return __builtin_cpu_supports("avx") ? room_overlap_avx : room_overlap_sse;
+#else
+	return room_overlap_plain;
+#endif
+}
+
+room_filter_fn pick_filter() {
+#if defined(__x86_64__)
+	return __builtin_cpu_supports("avx") ? room_filter_avx : room_filter_sse;
+#else
+	return room_filter_plain;
+#endif
+}
+
+// separate all rooms from each other. the start circle is always packed
+// tighter than rooms can sit, so first all positions are scaled up about
+// the center until rooms cover at most param_fill of it. most rooms are
+// then clear already or a push or two away, instead of every later room
+// having to travel out through everything placed before it.
+//
+// rooms are then placed one at a time from the center out, each against
+// the ones already placed. a room that overlaps one gets pushed out along
+// the axis of the minimum translation vector of that first overlap, away
+// from the center, then keeps going the same way, exactly far enough to
+// clear each further room in its path. it never moves back, so every room
+// is placed after a bounded number of pushes. rooms are snapped to whole
+// tiles as they are placed, which keeps the push arithmetic exact: a room
+// pushed to just clear another must not come out a rounding error short of
+// it. returns the total number of pushes
+long long separate_rooms(room_t * rooms, room_geom_t & g) {
+	int n = g.n;
+	room_overlap_fn overlap = pick_overlap();
+	room_hash_t hs;
+	room_hash_init(hs, g);
+
+	// spread
+	double area = 0;
+	double r2 = 0;
+	for (int i = 0; i < n; i++) {
+		area += (g.w[i] + param_gap) * (double) (g.h[i] + param_gap);
+		r2 = std::max(r2, (double) g.x[i] * g.x[i] + (double) g.y[i] * g.y[i]);
+	}
+	double scale = sqrt(area / (param_fill * PI * std::max(r2, 1.0)));
+	if (scale > 1) {
+		for (int i = 0; i < n; i++) {
+			g.x[i] *= scale;
+			g.y[i] *= scale;
+		}
+	}
+
+	// placement order, from the center out
+	std::vector<std::pair<float, int> > order(n);
+	for (int i = 0; i < n; i++)
+		order[i] = std::make_pair(g.x[i] * g.x[i] + g.y[i] * g.y[i], i);
+	std::sort(order.begin(), order.end());
+
+	long long pushes = 0;
+	for (int k = 0; k < n; k++) {
+		int q = order[k].second;
+		g.x[q] = roundf(g.x[q]);
+		g.y[q] = roundf(g.y[q]);
+		int axis = -1; // 0 moves along x, 1 along y
+		int sign = 0;
+		for (int o = overlap(hs, g, q); o >= 0; o = overlap(hs, g, q)) {
+			float right = g.x[o] + g.w[o] + param_gap - g.x[q];
+			float left = g.x[q] + g.w[q] + param_gap - g.x[o];
+			float down = g.y[o] + g.h[o] + param_gap - g.y[q];
+			float up = g.y[q] + g.h[q] + param_gap - g.y[o];
+			if (axis < 0) {
+				// the shorter way out of the first room we hit, outwards
+				axis = (std::min(right, left) <= std::min(down, up)) ? 0 : 1;
+				if (axis == 0) {
+					sign = (g.x[q] + g.w[q] * 0.5f >= 0) ? 1 : -1;
+				} else {
+					sign = (g.y[q] + g.h[q] * 0.5f >= 0) ? 1 : -1;
+				}
+			}
+			if (axis == 0) {
+				g.x[q] += (sign > 0) ? right : -left;
+			} else {
+				g.y[q] += (sign > 0) ? down : -up;
+			}
+			pushes++;
+		}
+		rooms[q].fixed = true;
+		room_hash_insert(hs, g, q);
+	}
+	return pushes;
+}
+
+// delaunay triangulation by sweep hull. points are added in order of
+// distance from a seed triangle, each one joined to the hull edges it sees
+// and the new triangles made delaunay again by edge flips. a hash of the
+// hull by angle around the seed finds a visible edge in O(1) expected, so
+// the whole thing is O(n log n), the sort. triangles are point triples in
+// tri, counterclockwise on the tile grid where y grows down, and half[e]
+// is the halfedge opposite halfedge e, -1 on the hull. halfedge e goes
+// from tri[e] to tri[next_halfedge(e)]
+struct delaunay_t {
+	std::vector<int> tri;
+	std::vector<int> half;
+	int n_tri; // used entries of tri and half
+
+	// hull, as a doubly linked list of points
+	std::vector<int> hull_prev;
+	std::vector<int> hull_next;
+	std::vector<int> hull_tri; // halfedge on the hull leaving each point
+	std::vector<int> hull_hash;
+	int hull_start;
+	double cx, cy; // hash center
+	std::vector<int> flips; // halfedges left to check in delaunay_legalize
+};
+
+static inline int next_halfedge(int e) {
+	return (e % 3 == 2) ? e - 2 : e + 1;
+}
+
+// true when p, q, r turn clockwise on the tile grid
+static inline bool orient(double px, double py, double qx, double qy, double rx, double ry) {
+	return (qy - py) * (rx - qx) - (qx - px) * (ry - qy) < 0;
+}
+
+static inline bool in_circle(double ax, double ay, double bx, double by, double cx, double cy, double px, double py) {
+	double dx = ax - px;
+	double dy = ay - py;
+	double ex = bx - px;
+	double ey = by - py;
+	double fx = cx - px;
+	double fy = cy - py;
+	double ap = dx * dx + dy * dy;
+	double bp = ex * ex + ey * ey;
+	double cp = fx * fx + fy * fy;
+	return dx * (ey * cp - bp * fy) - dy * (ex * cp - bp * fx) + ap * (ex * fy - ey * fx) < 0;
+}
+
+// circumcenter of a, b, c relative to a, infinite when they are collinear
+static inline void circum_offset(double ax, double ay, double bx, double by, double cx, double cy, double & ox, double & oy) {
+	double dx = bx - ax;
+	double dy = by - ay;
+	double ex = cx - ax;
+	double ey = cy - ay;
+	double bl = dx * dx + dy * dy;
+	double cl = ex * ex + ey * ey;
+	double d = 0.5 / (dx * ey - dy * ex);
+	ox = (ey * bl - dy * cl) * d;
+	oy = (dx * cl - ex * bl) * d;
+}
+
+static inline int hull_key(const delaunay_t & d, double x, double y) {
+	// pseudo angle in [0, 1), monotone in the real one
+	double dx = x - d.cx;
+	double dy = y - d.cy;
+	if (dx == 0 && dy == 0) return 0; // any start will do
+	double p = dx / (fabs(dx) + fabs(dy));
+	double a = ((dy > 0) ? 3 - p : 1 + p) / 4;
+	int size = (int) d.hull_hash.size();
+	return (int) floor(a * size) % size;
+}
+
+static inline void link_halfedges(delaunay_t & d, int a, int b) {
+	d.half[a] = b;
+	if (b != -1) d.half[b] = a;
+}
+
+static int add_triangle(delaunay_t & d, int i0, int i1, int i2, int a, int b, int c) {
+	int t = d.n_tri;
+	d.tri[t] = i0;
+	d.tri[t + 1] = i1;
+	d.tri[t + 2] = i2;
+	link_halfedges(d, t, a);
+	link_halfedges(d, t + 1, b);
+	link_halfedges(d, t + 2, c);
+	d.n_tri += 3;
+	return t;
+}
+
+// flip halfedge a and whatever that breaks until the triangles around it
+// are delaunay again. returns the halfedge that took a's place
+static int delaunay_legalize(delaunay_t & d, const double * px, const double * py, int a) {
+	int ar = 0;
+	d.flips.clear();
+	for (;;) {
+		int b = d.half[a];
+		int a0 = a - a % 3;
+		ar = a0 + (a + 2) % 3;
+		if (b == -1) { // hull edge, nothing on the other side
+			if (d.flips.empty()) break;
+			a = d.flips.back();
+			d.flips.pop_back();
+			continue;
+		}
+
+		int b0 = b - b % 3;
+		int al = a0 + (a + 1) % 3;
+		int bl = b0 + (b + 2) % 3;
+		int p0 = d.tri[ar];
+		int pr = d.tri[a];
+		int pl = d.tri[al];
+		int p1 = d.tri[bl];
+		if (in_circle(px[p0], py[p0], px[pr], py[pr], px[pl], py[pl], px[p1], py[p1])) {
+			d.tri[a] = p1;
+			d.tri[b] = p0;
+			int hbl = d.half[bl];
+			if (hbl == -1) { // flipped a hull edge, point its hull entry at a
+				int e = d.hull_start;
+				do {
+					if (d.hull_tri[e] == bl) {
+						d.hull_tri[e] = a;
+						break;
+					}
+					e = d.hull_prev[e];
+				} while (e != d.hull_start);
+			}
+			link_halfedges(d, a, hbl);
+			link_halfedges(d, b, d.half[ar]);
+			link_halfedges(d, ar, bl);
+			d.flips.push_back(b0 + (b + 1) % 3);
+		} else {
+			if (d.flips.empty()) break;
+			a = d.flips.back();
+			d.flips.pop_back();
+		}
+	}
+	return ar;
+}
+
+// triangulate n points. leaves no triangles when there are fewer than 3
+// or they are all on one line. points must be distinct
+void delaunay_build(delaunay_t & d, const double * px, const double * py, int n) {
+	d.n_tri = 0;
+	if (n < 3) return;
+
+	double min_x = px[0], min_y = py[0], max_x = px[0], max_y = py[0];
+	for (int i = 1; i < n; i++) {
+		min_x = std::min(min_x, px[i]);
+		min_y = std::min(min_y, py[i]);
+		max_x = std::max(max_x, px[i]);
+		max_y = std::max(max_y, py[i]);
+	}
+	double mx = (min_x + max_x) / 2;
+	double my = (min_y + max_y) / 2;
+
+	// seed triangle: the point nearest the middle, its nearest point, and
+	// the point making the smallest circumcircle with those two
+	int i0 = 0, i1 = -1, i2 = -1;
+	double best = DBL_MAX;
+	for (int i = 0; i < n; i++) {
+		double dd = (px[i] - mx) * (px[i] - mx) + (py[i] - my) * (py[i] - my);
+		if (dd < best) {
+			best = dd;
+			i0 = i;
+		}
+	}
+	best = DBL_MAX;
+	for (int i = 0; i < n; i++) {
+		if (i == i0) continue;
+		double dd = (px[i] - px[i0]) * (px[i] - px[i0]) + (py[i] - py[i0]) * (py[i] - py[i0]);
+		if (dd < best) {
+			best = dd;
+			i1 = i;
+		}
+	}
+	best = DBL_MAX;
+	for (int i = 0; i < n; i++) {
+		if (i == i0 || i == i1) continue;
+		double ox, oy;
+		circum_offset(px[i0], py[i0], px[i1], py[i1], px[i], py[i], ox, oy);
+		double r = ox * ox + oy * oy;
+		if (r < best) {
+			best = r;
+			i2 = i;
+		}
+	}
+	if (i2 < 0 || best == DBL_MAX) return; // collinear
+
+	if (orient(px[i0], py[i0], px[i1], py[i1], px[i2], py[i2])) std::swap(i1, i2);
+	double ox, oy;
+	circum_offset(px[i0], py[i0], px[i1], py[i1], px[i2], py[i2], ox, oy);
+	d.cx = px[i0] + ox;
+	d.cy = py[i0] + oy;
+
+	// everything else by distance from the seed circle's center
+	std::vector<std::pair<double, int> > order(n);
+	for (int i = 0; i < n; i++)
+		order[i] = std::make_pair((px[i] - d.cx) * (px[i] - d.cx) + (py[i] - d.cy) * (py[i] - d.cy), i);
+	std::sort(order.begin(), order.end());
+
+	int max_tri = 2 * n - 5;
+	d.tri.resize(3 * max_tri);
+	d.half.resize(3 * max_tri);
+	d.hull_prev.resize(n);
+	d.hull_next.resize(n);
+	d.hull_tri.resize(n);
+	d.hull_hash.assign((int) ceil(sqrt((double) n)), -1);
+
+	d.hull_start = i0;
+	d.hull_next[i0] = d.hull_prev[i2] = i1;
+	d.hull_next[i1] = d.hull_prev[i0] = i2;
+	d.hull_next[i2] = d.hull_prev[i1] = i0;
+	d.hull_tri[i0] = 0;
+	d.hull_tri[i1] = 1;
+	d.hull_tri[i2] = 2;
+	d.hull_hash[hull_key(d, px[i0], py[i0])] = i0;
+	d.hull_hash[hull_key(d, px[i1], py[i1])] = i1;
+	d.hull_hash[hull_key(d, px[i2], py[i2])] = i2;
+	add_triangle(d, i0, i1, i2, -1, -1, -1);
+
+	for (int k = 0; k < n; k++) {
+		int i = order[k].second;
+		if (i == i0 || i == i1 || i == i2) continue;
+		double x = px[i];
+		double y = py[i];
+
+		// a hull edge visible from the point, starting from the hash
+		int key = hull_key(d, x, y);
+		int size = (int) d.hull_hash.size();
+		int start = 0;
+		for (int j = 0; j < size; j++) {
+			start = d.hull_hash[(key + j) % size];
+			if (start != -1 && start != d.hull_next[start]) break;
+		}
+		start = d.hull_prev[start];
+		int e = start;
+		int q = d.hull_next[e];
+		while (!orient(x, y, px[e], py[e], px[q], py[q])) {
+			e = q;
+			if (e == start) {
+				e = -1;
+				break;
+			}
+			q = d.hull_next[e];
+		}
+		if (e == -1) continue; // on the hull already, can't happen for distinct points
+
+		int t = add_triangle(d, e, i, d.hull_next[e], -1, -1, d.hull_tri[e]);
+		d.hull_tri[i] = delaunay_legalize(d, px, py, t + 2);
+		d.hull_tri[e] = t;
+
+		// walk forward along the hull, adding triangles while it stays visible
+		int nx = d.hull_next[e];
+		for (q = d.hull_next[nx]; orient(x, y, px[nx], py[nx], px[q], py[q]); q = d.hull_next[nx]) {
+			t = add_triangle(d, nx, i, q, d.hull_tri[i], -1, d.hull_tri[nx]);
+			d.hull_tri[i] = delaunay_legalize(d, px, py, t + 2);
+			d.hull_next[nx] = nx; // off the hull
+			nx = q;
+		}
+
+		// and backwards, when the first visible edge was where the walk began
+		if (e == start) {
+			for (q = d.hull_prev[e]; orient(x, y, px[q], py[q], px[e], py[e]); q = d.hull_prev[e]) {
+				t = add_triangle(d, q, i, e, -1, d.hull_tri[e], d.hull_tri[q]);
+				delaunay_legalize(d, px, py, t + 2);
+				d.hull_tri[q] = t;
+				d.hull_next[e] = e;
+				e = q;
+			}
+		}
+
+		d.hull_start = d.hull_prev[i] = e;
+		d.hull_next[e] = d.hull_prev[nx] = i;
+		d.hull_next[i] = nx;
+		d.hull_hash[hull_key(d, x, y)] = i;
+		d.hull_hash[hull_key(d, px[e], py[e])] = e;
+	}
+}
+
+// a candidate link, ordered by length
+struct link_cand_t {
+	double dist2;
+	int a;
+	int b;
+
+	bool operator<(const link_cand_t & o) const { return dist2 < o.dist2; }
+};
+
+static int uf_find(std::vector<int> & parent, int i) {
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+// link the rooms of g into a connected graph: the minimum spanning tree of
+// the delaunay triangulation of the room centers, which is the euclidean
+// one, plus loop_fraction of the remaining delaunay edges picked at random
+// so the dungeon has some loops. distances are between centers. returns
+// the spanning tree edges first, then the loops, in an array of exactly
+// n_links edges
+graph_edge_t * link_rooms(const room_geom_t & g, float loop_fraction, int & n_links) {
+	int n = g.n;
+	std::vector<double> px(n), py(n);
+	for (int i = 0; i < n; i++) {
+		px[i] = g.x[i] + g.w[i] / 2.0;
+		py[i] = g.y[i] + g.h[i] / 2.0;
+	}
+
+	// candidate edges, each delaunay edge once
+	std::vector<link_cand_t> cand;
+	delaunay_t d;
+	delaunay_build(d, &px[0], &py[0], n);
+	if (d.n_tri > 0) {
+		cand.reserve(d.n_tri / 2 + n);
+		for (int e = 0; e < d.n_tri; e++) {
+			if (d.half[e] > e) continue;
+			int a = d.tri[e];
+			int b = d.tri[next_halfedge(e)];
+			link_cand_t c = {(px[a] - px[b]) * (px[a] - px[b]) + (py[a] - py[b]) * (py[a] - py[b]), a, b};
+			cand.push_back(c);
+		}
+	} else if (n > 1) {
+		// fewer than 3 rooms or all on one line: the path along the line
+		std::vector<std::pair<std::pair<double, double>, int> > line(n);
+		for (int i = 0; i < n; i++)
+			line[i] = std::make_pair(std::make_pair(px[i], py[i]), i);
+		std::sort(line.begin(), line.end());
+		for (int i = 1; i < n; i++) {
+			int a = line[i - 1].second;
+			int b = line[i].second;
+			link_cand_t c = {(px[a] - px[b]) * (px[a] - px[b]) + (py[a] - py[b]) * (py[a] - py[b]), a, b};
+			cand.push_back(c);
+		}
+	}
+	std::sort(cand.begin(), cand.end());
+
+	// kruskal. the tree edges go to the front of cand, the rest after
+	std::vector<int> parent(n);
+	for (int i = 0; i < n; i++)
+		parent[i] = i;
+	int n_tree = 0;
+	for (int k = 0; k < (int) cand.size(); k++) {
+		int ra = uf_find(parent, cand[k].a);
+		int rb = uf_find(parent, cand[k].b);
+		if (ra == rb) continue;
+		parent[ra] = rb;
+		std::swap(cand[n_tree++], cand[k]);
+	}
+
+	// loops, a random loop_fraction of the rest moved up behind the tree
+	int n_rest = (int) cand.size() - n_tree;
+	int n_loops = std::min(n_rest, std::max(0, (int) (loop_fraction * n_rest + 0.5f)));
+	for (int k = 0; k < n_loops; k++) {
+		int r = n_tree + k + std::min(n_rest - k - 1, (int) (rand_n() * (n_rest - k)));
+		std::swap(cand[n_tree + k], cand[r]);
+	}
+
+	n_links = n_tree + n_loops;
+	graph_edge_t * links = new graph_edge_t[n_links];
+	for (int k = 0; k < n_links; k++)
+		links[k] = {global_uuid_idx++, cand[k].a, cand[k].b, (float) sqrt(cand[k].dist2)};
+	return links;
+}
+
+// static 2d tree over room centers, for nearest room and rooms within a
+// radius queries. built once by median splits into an implicit balanced
+// tree: the node for positions [lo, hi) holds the point at mid = (lo + hi)
+// / 2 and splits on axis[mid], with [lo, mid) on the low side and (mid, hi)
+// on the high side. ranges of KD_LEAF points or fewer are leaves and just
+// get scanned. rooms can be retired, after which queries skip them, and
+// alive[mid] counts what is left of each range so emptied subtrees are
+// never entered
+const int KD_LEAF = 8;
+
+struct kd_tree_t {
+	int n;
+	std::vector<float> x; // center of the room at each position
+	std::vector<float> y;
+	std::vector<int> id; // room at each position
+	std::vector<int> pos; // position of each room
+	std::vector<unsigned char> axis; // 0 splits on x, 1 on y
+	std::vector<unsigned char> dead;
+	std::vector<int> alive;
+};
+
+struct kd_less_t {
+	const float * c; // x or y of each room
+	bool operator()(int a, int b) const { return c[a] < c[b]; }
+};
+
+static void kd_build_range(kd_tree_t & t, const float * cx, const float * cy, int lo, int hi) {
+	int mid = (lo + hi) / 2;
+	t.alive[mid] = hi - lo;
+	if (hi - lo <= KD_LEAF) return;
+
+	// split the longer side
+	float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX;
+	for (int p = lo; p < hi; p++) {
+		x0 = std::min(x0, cx[t.id[p]]);
+		x1 = std::max(x1, cx[t.id[p]]);
+		y0 = std::min(y0, cy[t.id[p]]);
+		y1 = std::max(y1, cy[t.id[p]]);
+	}
+	t.axis[mid] = (y1 - y0 > x1 - x0) ? 1 : 0;
+	kd_less_t less = {t.axis[mid] ? cy : cx};
+	std::nth_element(t.id.begin() + lo, t.id.begin() + mid, t.id.begin() + hi, less);
+	kd_build_range(t, cx, cy, lo, mid);
+	kd_build_range(t, cx, cy, mid + 1, hi);
+}
+
+void kd_build(kd_tree_t & t, const room_geom_t & g) {
+	int n = g.n;
+	std::vector<float> cx(n), cy(n);
+	for (int i = 0; i < n; i++) {
+		cx[i] = g.x[i] + g.w[i] / 2;
+		cy[i] = g.y[i] + g.h[i] / 2;
+	}
+	t.n = n;
+	t.id.resize(n);
+	for (int i = 0; i < n; i++)
+		t.id[i] = i;
+	t.axis.assign(n, 0);
+	t.dead.assign(n, 0);
+	t.alive.assign(n, 0);
+	if (n > 0) kd_build_range(t, &cx[0], &cy[0], 0, n);
+
+	t.x.resize(n);
+	t.y.resize(n);
+	t.pos.resize(n);
+	for (int p = 0; p < n; p++) {
+		t.x[p] = cx[t.id[p]];
+		t.y[p] = cy[t.id[p]];
+		t.pos[t.id[p]] = p;
+	}
+}
+
+// stop returning room i from queries
+void kd_retire(kd_tree_t & t, int i) {
+	int p = t.pos[i];
+	if (t.dead[p]) return;
+	t.dead[p] = 1;
+	int lo = 0, hi = t.n;
+	for (;;) {
+		int mid = (lo + hi) / 2;
+		t.alive[mid]--;
+		if (hi - lo <= KD_LEAF || p == mid) break;
+		if (p < mid) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+}
+
+// up to k best rooms so far, nearest first
+struct kd_best_t {
+	int k;
+	int n;
+	int * id;
+	float * d2;
+
+	float worst() const { return (n < k) ? FLT_MAX : d2[n - 1]; }
+
+	void add(int i, float d) {
+		int j = (n < k) ? n++ : n - 1;
+		while (j > 0 && d2[j - 1] > d) {
+			id[j] = id[j - 1];
+			d2[j] = d2[j - 1];
+			j--;
+		}
+		id[j] = i;
+		d2[j] = d;
+	}
+};
+
+template <class P> static inline void kd_visit(const kd_tree_t & t, int p, float qx, float qy, P & pred, kd_best_t & best) {
+	if (t.dead[p]) return;
+	float dx = t.x[p] - qx;
+	float dy = t.y[p] - qy;
+	float d = dx * dx + dy * dy;
+	if (d < best.worst() && pred(t.id[p])) best.add(t.id[p], d);
+}
+
+template <class P> static void kd_nearest_range(const kd_tree_t & t, int lo, int hi, float qx, float qy, P & pred, kd_best_t & best) {
+	int mid = (lo + hi) / 2;
+	if (t.alive[mid] == 0) return;
+	if (hi - lo <= KD_LEAF) {
+		for (int p = lo; p < hi; p++)
+			kd_visit(t, p, qx, qy, pred, best);
+		return;
+	}
+
+	float off = t.axis[mid] ? qy - t.y[mid] : qx - t.x[mid];
+	if (off < 0) {
+		kd_nearest_range(t, lo, mid, qx, qy, pred, best);
+	} else {
+		kd_nearest_range(t, mid + 1, hi, qx, qy, pred, best);
+	}
+	if (off * off >= best.worst()) return;
+	kd_visit(t, mid, qx, qy, pred, best);
+	if (off < 0) {
+		kd_nearest_range(t, mid + 1, hi, qx, qy, pred, best);
+	} else {
+		kd_nearest_range(t, lo, mid, qx, qy, pred, best);
+	}
+}
+
+// the up to k rooms nearest to (qx, qy), nearest first, among those not
+// retired for which pred(room) is true. returns how many were found and
+// fills ids and, when not NULL, their squared distances
+template <class P> int kd_nearest(const kd_tree_t & t, float qx, float qy, int k, P pred, int * ids, float * d2 = NULL) {
+	std::vector<float> dist;
+	if (d2 == NULL) {
+		dist.resize(k);
+		d2 = &dist[0];
+	}
+	kd_best_t best = {k, 0, ids, d2};
+	if (t.n > 0 && k > 0) kd_nearest_range(t, 0, t.n, qx, qy, pred, best);
+	return best.n;
+}
+
+static void kd_within_range(const kd_tree_t & t, int lo, int hi, float qx, float qy, float r2, std::vector<int> & out) {
+	int mid = (lo + hi) / 2;
+	if (t.alive[mid] == 0) return;
+	if (hi - lo <= KD_LEAF) {
+		for (int p = lo; p < hi; p++) {
+			float dx = t.x[p] - qx;
+			float dy = t.y[p] - qy;
+			if (!t.dead[p] && dx * dx + dy * dy <= r2) out.push_back(t.id[p]);
+		}
+		return;
+	}
+
+	float off = t.axis[mid] ? qy - t.y[mid] : qx - t.x[mid];
+	float dx = t.x[mid] - qx;
+	float dy = t.y[mid] - qy;
+	if (!t.dead[mid] && dx * dx + dy * dy <= r2) out.push_back(t.id[mid]);
+	if (off < 0 || off * off <= r2) kd_within_range(t, lo, mid, qx, qy, r2, out);
+	if (off >= 0 || off * off <= r2) kd_within_range(t, mid + 1, hi, qx, qy, r2, out);
+}
+
+// append the rooms not retired whose centers are within r of (qx, qy)
+void kd_within(const kd_tree_t & t, float qx, float qy, float r, std::vector<int> & out) {
+	if (t.n > 0) kd_within_range(t, 0, t.n, qx, qy, r * r, out);
+}
+
+// neighbour slots of a room, -1 when free
+static inline bool room_full(const room_t & r) {
+	return r.n1 != -1 && r.n2 != -1 && r.n3 != -1;
+}
+
+static inline bool room_linked(const room_t & r, int j) {
+	return r.n1 == j || r.n2 == j || r.n3 == j;
+}
+
+static inline void room_add_neighbor(room_t & r, int j) {
+	if (r.n1 == -1) {
+		r.n1 = j;
+	} else if (r.n2 == -1) {
+		r.n2 = j;
+	} else if (r.n3 == -1) {
+		r.n3 = j;
+	}
+}
+
+// nearest room candidates for room i: any other room it isn't linked to
+// yet. rooms with full slots are retired from the tree
+struct link_free_t {
+	const room_t * rooms;
+	int i;
+	bool operator()(int j) const { return j != i && !room_linked(rooms[i], j); }
+};
+
+// link every room to its nearest rooms that still have a free neighbour
+// slot, until it has two neighbours or its slots or candidates run out.
+// rooms end up with at most three neighbours in n1, n2, n3, which are
+// indices into rooms. unlike link_rooms the result needn't be connected.
+// returns the links in an array of exactly n_links edges
+graph_edge_t * link_rooms_nearest(room_t * rooms, const room_geom_t & g, int & n_links) {
+	kd_tree_t t;
+	kd_build(t, g);
+	for (int i = 0; i < g.n; i++) {
+		if (room_full(rooms[i])) kd_retire(t, i);
+	}
+
+	std::vector<graph_edge_t> links;
+	for (int i = 0; i < g.n; i++) {
+		float cx = g.x[i] + g.w[i] / 2;
+		float cy = g.y[i] + g.h[i] / 2;
+		while (rooms[i].n2 == -1) {
+			int j;
+			float d2;
+			link_free_t pred = {rooms, i};
+			if (kd_nearest(t, cx, cy, 1, pred, &j, &d2) == 0) break;
+
+			room_add_neighbor(rooms[i], j);
+			room_add_neighbor(rooms[j], i);
+			if (room_full(rooms[j])) kd_retire(t, j);
+			graph_edge_t e = {global_uuid_idx++, i, j, sqrtf(d2)};
+			links.push_back(e);
+		}
+		if (room_full(rooms[i])) kd_retire(t, i);
+	}
+
+	n_links = (int) links.size();
+	graph_edge_t * out = new graph_edge_t[n_links];
+	if (n_links > 0) memcpy(out, &links[0], n_links * sizeof(graph_edge_t));
+	return out;
+}
+
+// the dungeon as tiles, one byte each so spans can be memset, covering the
+// bounding box of all rooms. room_at is the room id raster, 1 + the index
+// of the room on each tile and 0 between rooms, which rooms never share
+// since they are separated
+enum { TILE_EMPTY = 0, TILE_ROOM = 1, TILE_CORRIDOR = 2 };
+
+struct dungeon_t {
+	int x0, y0; // position of tile 0, 0
+	int w, h;
+	std::vector<unsigned char> tile;
+	std::vector<int> room_at;
+	std::vector<unsigned char> added; // rooms that are part of the dungeon
+};
+
+// size the grid around the rooms of g and raster them into room_at. a
+// margin keeps the rooms off the edge
+void dungeon_init(dungeon_t & d, const room_geom_t & g) {
+	float x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+	for (int i = 0; i < g.n; i++) {
+		if (i == 0 || g.x[i] < x0) x0 = g.x[i];
+		if (i == 0 || g.y[i] < y0) y0 = g.y[i];
+		if (i == 0 || g.x[i] + g.w[i] > x1) x1 = g.x[i] + g.w[i];
+		if (i == 0 || g.y[i] + g.h[i] > y1) y1 = g.y[i] + g.h[i];
+	}
+	d.x0 = (int) floorf(x0) - 1;
+	d.y0 = (int) floorf(y0) - 1;
+	d.w = (int) ceilf(x1) + 1 - d.x0;
+	d.h = (int) ceilf(y1) + 1 - d.y0;
+	d.tile.assign((size_t) d.w * d.h, TILE_EMPTY);
+	d.room_at.assign((size_t) d.w * d.h, 0);
+	d.added.assign(g.n, 0);
+
+	for (int i = 0; i < g.n; i++) {
+		int x = (int) g.x[i] - d.x0;
+		for (int y = (int) g.y[i] - d.y0; y < (int) (g.y[i] + g.h[i]) - d.y0; y++) {
+			int * row = &d.room_at[(size_t) y * d.w];
+			std::fill(row + x, row + x + (int) g.w[i], i + 1);
+		}
+	}
+}
+
+// corridor tiles over [x0, x1) x [y0, y1) in grid coordinates, one memset
+// a row. every room the corridor runs into is added to the dungeon
+static void carve_span(dungeon_t & d, int x0, int x1, int y0, int y1) {
+	for (int y = y0; y < y1; y++) {
+		const int * ids = &d.room_at[(size_t) y * d.w];
+		for (int x = x0; x < x1; x++) {
+			if (ids[x] != 0) d.added[ids[x] - 1] = 1;
+		}
+		memset(&d.tile[(size_t) y * d.w + x0], TILE_CORRIDOR, x1 - x0);
+	}
+}
+
+// corridor between main rooms a and b: straight down the middle of where
+// they line up when they do by at least a corridor width, otherwise an L
+// from the center of a across to above or below the center of b
+static void carve_link(dungeon_t & d, const room_geom_t & g, int a, int b) {
+	const int half = param_corridor / 2;
+	int ax = (int) (g.x[a] + g.w[a] / 2) - d.x0;
+	int ay = (int) (g.y[a] + g.h[a] / 2) - d.y0;
+	int bx = (int) (g.x[b] + g.w[b] / 2) - d.x0;
+	int by = (int) (g.y[b] + g.h[b] / 2) - d.y0;
+	int lo_x = (int) std::max(g.x[a], g.x[b]) - d.x0;
+	int hi_x = (int) std::min(g.x[a] + g.w[a], g.x[b] + g.w[b]) - d.x0;
+	int lo_y = (int) std::max(g.y[a], g.y[b]) - d.y0;
+	int hi_y = (int) std::min(g.y[a] + g.h[a], g.y[b] + g.h[b]) - d.y0;
+
+	if (hi_x - lo_x >= param_corridor) {
+		int x = (lo_x + hi_x) / 2 - half;
+		carve_span(d, x, x + param_corridor, std::min(ay, by), std::max(ay, by) + 1);
+	} else if (hi_y - lo_y >= param_corridor) {
+		int y = (lo_y + hi_y) / 2 - half;
+		carve_span(d, std::min(ax, bx), std::max(ax, bx) + 1, y, y + param_corridor);
+	} else {
+		carve_span(d, std::min(ax, bx) - half, std::max(ax, bx) - half + param_corridor,
+			ay - half, ay - half + param_corridor);
+		carve_span(d, bx - half, bx - half + param_corridor,
+			std::min(ay, by) - half, std::max(ay, by) - half + param_corridor);
+	}
+}
+
+// turn the links between the main rooms into corridors and flatten the
+// main rooms and every room a corridor runs into onto the tiles. d must
+// have been set up from all rooms, g. returns the number of rooms in the
+// dungeon
+int carve_dungeon(dungeon_t & d, const room_geom_t & g, const room_geom_t & main_geom,
+		const graph_edge_t * links, int n_links) {
+	for (int i = 0; i < main_geom.n; i++) {
+		int x = (int) (main_geom.x[i] + main_geom.w[i] / 2) - d.x0;
+		int y = (int) (main_geom.y[i] + main_geom.h[i] / 2) - d.y0;
+		d.added[d.room_at[(size_t) y * d.w + x] - 1] = 1;
+	}
+	for (int k = 0; k < n_links; k++)
+		carve_link(d, main_geom, links[k].id_target_a, links[k].id_target_b);
+
+	// rooms last, over the corridors running through them
+	int n = 0;
+	for (int i = 0; i < g.n; i++) {
+		if (!d.added[i]) continue;
+		n++;
+		int x = (int) g.x[i] - d.x0;
+		for (int y = (int) g.y[i] - d.y0; y < (int) (g.y[i] + g.h[i]) - d.y0; y++)
+			memset(&d.tile[(size_t) y * d.w + x], TILE_ROOM, (int) g.w[i]);
+	}
+	return n;
+}
+
+void dungeon_print(const dungeon_t & d) {
+	const char glyph[] = {' ', '#', '.'};
+	std::string line(d.w, ' ');
+	for (int y = 0; y < d.h; y++) {
+		for (int x = 0; x < d.w; x++)
+			line[x] = glyph[d.tile[(size_t) y * d.w + x]];
+		std::cout << line << '\n';
+	}
+	std::cout.flush();
+}
+
+// generate list of n rooms within a circle of radius r using normal distrib for size
+void generate_rooms(room_t * rooms, room_geom_t & g, float radius) {
+	for (int i = 0; i < g.n; i++){
 		// pick x, y inside radius
 		float t = 2 * PI * rand_n();
 		float u = rand_n() + rand_n();
 		float r = ((u > 1) ? 2 - u : u);
 		
-		rooms[i].x = param_radius * r * cos(t);
-		rooms[i].y = param_radius * r * sin(t);
+		g.x[i] = radius * r * cos(t);
+		g.y[i] = radius * r * sin(t);
 		
-		// pick w, h from distrib
-		rooms[i].w = rand_normal(10, 1.5);
-		rooms[i].h = rand_normal(10, 1.5);
+		// pick w, h from distrib, whole tiles
+		g.w[i] = (int) rand_normal(10, 1.5);
+		g.h[i] = (int) rand_normal(10, 1.5);
 		
 		// give it an id
 		rooms[i].id_self = global_uuid_idx++; 
@@ -132,238 +1192,319 @@ int main() {
 		rooms[i].n1 = -1;
 		rooms[i].n2 = -1;
 		rooms[i].n3 = -1;
-		
-		// update grid bounds
-		if (rooms[i].x < x_min) x_min = rooms[i].x;
-		if (rooms[i].y < y_min) y_min = rooms[i].y;
 	}
-	
-	// seperate all rooms from each other (seperation steering alg)
-	bool seperated = false;
-	int cycles = 1;
-	while (!seperated) {
-		// pick a random room
-		int idx = rand() % param_n_rooms;
-		while (rooms[idx].fixed) {
-			idx = rand() % param_n_rooms;
-		}
-		
-		// pick random direction (float, float)
-		float dx = rand_n() * ((rand() % 2) ? -1 : 1);
-		float dy = rand_n() * ((rand() % 2) ? -1 : 1);
-		
-		// for all unfixed rooms
-		for (int i = 0; i < param_n_rooms; i++){		
-			// wile it overlaps that room)
-			if (i == idx) continue;
-			
-			while (!(rooms[idx].x > rooms[i].x + rooms[i].w ||
-				rooms[i].x > rooms[idx].x + rooms[idx].w ||
-				rooms[idx].y > rooms[i].y + rooms[i].h ||
-				rooms[i].y > rooms[idx].y + rooms[idx].h)) {
-				// move it in direction until is does`
-				rooms[idx].x += dx;
-				rooms[idx].y += dy;
-				
-				//std::cout << rooms[idx].x << "," << rooms[idx].y << " | " << dx << "," << dy << " | " << i << " | " << cycles << "\r";
-				//std::cout << "[" << rooms[idx].x << "," << rooms[idx].y << "," << rooms[idx].w << "," << rooms[idx].h << "] ";
-				//std::cout << "[" << rooms[i].x << "," << rooms[i].y << "," << rooms[i].w << "," << rooms[i].h << "] ";
-				//std::cout << "i:" << i << " c:" << cycles << "           \r";
-			}		
-		}
-		
-		// mark it as fixed
-		rooms[idx].fixed = true;
-			
-		// if no unfixed rooms
-		bool escape = true;
-		for (int i = 0; i < param_n_rooms; i++){
-			if (!rooms[i].fixed) {
-				// algorithm complete
-				escape = false;
-				break;
-			}
+}
+
+// start radius for n rooms, growing with sqrt(n) so the starting density
+// stays what param_radius gives param_n_rooms
+float rooms_radius(int n) {
+	return param_radius * sqrt(n / (float) param_n_rooms);
+}
+
+// time separate_rooms and the main room filter on n rooms, and check that
+// no two rooms overlap afterwards
+void run_separate_bench(int n) {
+	room_t * rooms = new room_t[n];
+	room_geom_t g;
+	geom_init(g, n);
+	generate_rooms(rooms, g, rooms_radius(n));
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	long long pushes = separate_rooms(rooms, g);
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	int * idx = new int[n];
+	int n_main = pick_filter()(g, 8, 8, idx);
+	std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+	// placed order doesn't matter for the check, every room goes in
+	room_overlap_fn overlap = pick_overlap();
+	room_hash_t hs;
+	room_hash_init(hs, g);
+	long long overlaps = 0;
+	for (int i = 0; i < n; i++) {
+		if (overlap(hs, g, i) >= 0) overlaps++;
+		room_hash_insert(hs, g, i);
+	}
+
+	std::cout << "separate: " << n << " rooms ms: "
+		<< std::chrono::duration<double, std::milli>(t1 - t0).count()
+		<< " pushes: " << pushes << " overlaps: " << overlaps << std::endl;
+	std::cout << "filter: " << n_main << " main rooms ms: "
+		<< std::chrono::duration<double, std::milli>(t2 - t1).count() << std::endl;
+	delete[] idx;
+	geom_free(g);
+	delete[] rooms;
+}
+
+// copy the rooms bigger than 8x8 into main_rooms and main_geom
+room_t * select_main_rooms(const room_t * rooms, const room_geom_t & geom, room_geom_t & main_geom) {
+	int * idx = new int[geom.n];
+	int n = pick_filter()(geom, 8, 8, idx);
+	room_t * main_rooms = new room_t[n];
+	geom_init(main_geom, n);
+	for (int i = 0; i < n; i++) {
+		int r = idx[i];
+		main_rooms[i] = rooms[r];
+		main_geom.x[i] = geom.x[r];
+		main_geom.y[i] = geom.y[r];
+		main_geom.w[i] = geom.w[r];
+		main_geom.h[i] = geom.h[r];
+	}
+	delete[] idx;
+	return main_rooms;
+}
+
+// time link_rooms on the main rooms out of n separated rooms
+void run_link_bench(int n) {
+	room_t * rooms = new room_t[n];
+	room_geom_t geom;
+	geom_init(geom, n);
+	generate_rooms(rooms, geom, rooms_radius(n));
+	separate_rooms(rooms, geom);
+	room_geom_t main_geom;
+	room_t * main_rooms = select_main_rooms(rooms, geom, main_geom);
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	int n_links = 0;
+	graph_edge_t * links = link_rooms(main_geom, param_loops, n_links);
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+	// the tree edges alone must connect every room
+	std::vector<int> parent(main_geom.n);
+	for (int i = 0; i < main_geom.n; i++)
+		parent[i] = i;
+	int parts = main_geom.n;
+	double length = 0;
+	for (int k = 0; k < n_links; k++) {
+		int ra = uf_find(parent, links[k].id_target_a);
+		int rb = uf_find(parent, links[k].id_target_b);
+		if (ra != rb) {
+			parent[ra] = rb;
+			parts--;
+			length += links[k].distance;
 		}
+	}
 
-		if (escape) break;
-		
-		cycles++;
+	std::cout << "link: " << main_geom.n << " rooms ms: "
+		<< std::chrono::duration<double, std::milli>(t1 - t0).count()
+		<< " edges: " << n_links << " tree length: " << length
+		<< " components: " << parts << std::endl;
+	delete[] links;
+	delete[] main_rooms;
+	geom_free(main_geom);
+	geom_free(geom);
+	delete[] rooms;
+}
+
+// time the kd tree on the main rooms out of n separated rooms: building
+// it, link_rooms_nearest, and a 3 nearest and a within radius query per
+// room, checking a sample of the queries against a scan of all rooms
+void run_knn_bench(int n) {
+	room_t * rooms = new room_t[n];
+	room_geom_t geom;
+	geom_init(geom, n);
+	generate_rooms(rooms, geom, rooms_radius(n));
+	separate_rooms(rooms, geom);
+	room_geom_t main_geom;
+	room_t * main_rooms = select_main_rooms(rooms, geom, main_geom);
+	int m = main_geom.n;
+	const float radius = 30;
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	kd_tree_t t;
+	kd_build(t, main_geom);
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	int n_links = 0;
+	graph_edge_t * links = link_rooms_nearest(main_rooms, main_geom, n_links);
+	std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+	struct any_other_t {
+		int i;
+		bool operator()(int j) const { return j != i; }
+	};
+	std::vector<float> cx(m), cy(m);
+	for (int i = 0; i < m; i++) {
+		cx[i] = main_geom.x[i] + main_geom.w[i] / 2;
+		cy[i] = main_geom.y[i] + main_geom.h[i] / 2;
 	}
-	
-	int num_main_rooms = 0;
-	room_t* main_rooms = new room_t[param_n_rooms];
-	for (int i = 0; i < param_n_rooms; i++) {
-		// snap to grid
-		rooms[i].x = round(rooms[i].x);
-		rooms[i].y = round(rooms[i].y);
-	
-		// add by threshold
-		if (rooms[i].w > 8 && rooms[i].h > 8) 
-			main_rooms[num_main_rooms++] = rooms[i];
+	std::vector<int> near(3 * m);
+	std::vector<float> near_d2(3 * m);
+	for (int i = 0; i < m; i++) {
+		any_other_t pred = {i};
+		kd_nearest(t, cx[i], cy[i], 3, pred, &near[3 * i], &near_d2[3 * i]);
 	}
-	
-	{ // array resize hack
-		room_t* n = new room_t[num_main_rooms];
-		memcpy(n, main_rooms, num_main_rooms * sizeof(room_t));
-		delete[] main_rooms;
-		main_rooms = n;
+	std::chrono::steady_clock::time_point t3 = std::chrono::steady_clock::now();
+	long long found = 0;
+	std::vector<int> within;
+	for (int i = 0; i < m; i++) {
+		within.clear();
+		kd_within(t, cx[i], cy[i], radius, within);
+		found += within.size();
 	}
-	
-	// link rooms together
-	int top_link_idx = 0;
-	graph_edge_t * links = new graph_edge_t[num_main_rooms * num_main_rooms]; // i hope this is enough
-	for (int i = 0; i < num_main_rooms; i++){
-		// if room i has no free slots skip it
-		if (main_rooms[i].n1 != -1 &&
-			main_rooms[i].n2 != -1 && 
-			main_rooms[i].n3 != -1) continue;
-			
-		int id1 = main_rooms[i].n1; float d1 = -1;
-		int id2 = main_rooms[i].n2; float d2 = -1;
-		//int n3 = rooms[i].n3; float d3 = -1;
-		
-		for (int j = 0; j < param_n_rooms; j++){
-			if (j == i) continue; // this would be buggy
-			
-			// if room j has no free slots skip it
-			if (main_rooms[j].n1 != -1 &&
-				main_rooms[j].n2 != -1 && 
-				main_rooms[j].n3 != -1) continue;
-				
-			float dist = sqrt( pow(main_rooms[i].x - main_rooms[j].x, 2) * pow(main_rooms[i].y - main_rooms[j].y, 2) );
-			
-			if (dist < d1) {
-				d1 = dist;
-				id1 = j;
-			}	
+	std::chrono::steady_clock::time_point t4 = std::chrono::steady_clock::now();
+
+	int wrong = 0;
+	for (int i = 0; i < m; i += std::max(1, m / 500)) {
+		std::vector<float> d2;
+		int inside = 0;
+		for (int j = 0; j < m; j++) {
+			float dx = cx[j] - cx[i];
+			float dy = cy[j] - cy[i];
+			if (j != i) d2.push_back(dx * dx + dy * dy);
+			if (dx * dx + dy * dy <= radius * radius) inside++;
 		}
-		
-		// assign link for id1
-		if (main_rooms[i].n1 == -1) {
-			main_rooms[i].n1 = id1; // set room i to be linked with id1
-			if (main_rooms[id1].n1 == -1) {
-				main_rooms[id1].n1 = i;
-			} else if (main_rooms[id1].n2 == -1) {
-				main_rooms[id1].n2 = i;
-			} else if (main_rooms[id1].n3 == -1) {
-				main_rooms[id1].n3 = i;
-			}
-		} else if (main_rooms[i].n2 == -1) {
-			main_rooms[i].n2 = id1; // set room i to be linked with id1
-			if (main_rooms[id1].n1 == -1) {
-				main_rooms[id1].n1 = i;
-			} else if (main_rooms[id1].n2 == -1) {
-				main_rooms[id1].n2 = i;
-			} else if (main_rooms[id1].n3 == -1) {
-				main_rooms[id1].n3 = i;
-			}			
-		} else if (main_rooms[i].n3 == -1) {
-			main_rooms[i].n3 = id1; // set room i to be linked with id1
-			if (main_rooms[id1].n1 == -1) {
-				main_rooms[id1].n1 = i;
-			} else if (main_rooms[id1].n2 == -1) {
-				main_rooms[id1].n2 = i;
-			} else if (main_rooms[id1].n3 == -1) {
-				main_rooms[id1].n3 = i;
+		std::sort(d2.begin(), d2.end());
+		for (int k = 0; k < 3 && k < (int) d2.size(); k++)
+			if (d2[k] != near_d2[3 * i + k]) wrong++;
+		within.clear();
+		kd_within(t, cx[i], cy[i], radius, within);
+		if ((int) within.size() != inside) wrong++;
+	}
+
+	std::cout << "knn: " << m << " rooms build ms: "
+		<< std::chrono::duration<double, std::milli>(t1 - t0).count()
+		<< " link ms: " << std::chrono::duration<double, std::milli>(t2 - t1).count()
+		<< " edges: " << n_links
+		<< " nearest 3 ms: " << std::chrono::duration<double, std::milli>(t3 - t2).count()
+		<< " within " << radius << " ms: " << std::chrono::duration<double, std::milli>(t4 - t3).count()
+		<< " found: " << found << " wrong: " << wrong << std::endl;
+	delete[] links;
+	delete[] main_rooms;
+	geom_free(main_geom);
+	geom_free(geom);
+	delete[] rooms;
+}
+
+// time the corridor stage on the dungeon out of n rooms, and check that
+// the tiles connect all main rooms, as the linked graph does
+void run_corridor_bench(int n) {
+	room_t * rooms = new room_t[n];
+	room_geom_t geom;
+	geom_init(geom, n);
+	generate_rooms(rooms, geom, rooms_radius(n));
+	separate_rooms(rooms, geom);
+	room_geom_t main_geom;
+	room_t * main_rooms = select_main_rooms(rooms, geom, main_geom);
+	int n_links = 0;
+	graph_edge_t * links = link_rooms(main_geom, param_loops, n_links);
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	dungeon_t d;
+	dungeon_init(d, geom);
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	int n_added = carve_dungeon(d, geom, main_geom, links, n_links);
+	std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+	// flood the tiles from the first main room
+	std::vector<unsigned char> seen(d.tile.size(), 0);
+	std::vector<size_t> stack;
+	if (main_geom.n > 0) {
+		int x = (int) (main_geom.x[0] + main_geom.w[0] / 2) - d.x0;
+		int y = (int) (main_geom.y[0] + main_geom.h[0] / 2) - d.y0;
+		stack.push_back((size_t) y * d.w + x);
+		seen[stack.back()] = 1;
+	}
+	long long tiles = 0;
+	while (!stack.empty()) {
+		size_t t = stack.back();
+		stack.pop_back();
+		tiles++;
+		size_t next[4] = {t - 1, t + 1, t - d.w, t + d.w};
+		for (int k = 0; k < 4; k++) {
+			if (!seen[next[k]] && d.tile[next[k]] != TILE_EMPTY) {
+				seen[next[k]] = 1;
+				stack.push_back(next[k]);
 			}
 		}
-		
-		//graph_edge_t g1 = {global_uuid_idx++, i, id1, d1};
-		links[top_link_idx++] = {global_uuid_idx++, i, id1, d1};
-		if (main_rooms[i].n3 > 0) continue;
-		
-		for (int j = 0; j < param_n_rooms; j++){
-			if (j == i) continue; // this would be buggy
-			if (j == id1) continue; // if this is prior room skip it too
-			
-			// if room j has no free slots skip it
-			if (main_rooms[j].n1 != -1 &&
-				main_rooms[j].n2 != -1 && 
-				main_rooms[j].n3 != -1) continue;
-				
-			float dist = sqrt( pow(main_rooms[i].x - main_rooms[j].x, 2) * pow(main_rooms[i].y - main_rooms[j].y, 2) );
-			
-			if (dist < d2) {
-				d2 = dist;
-				id2 = j;
-			}	
-		}
-		
-		// assign link for id2	
-		if (main_rooms[i].n1 == -1) {
-			main_rooms[i].n1 = id2; // set room i to be linked with id1
-			if (main_rooms[id2].n1 == -1) {
-				main_rooms[id2].n1 = i;
-			} else if (main_rooms[id2].n2 == -1) {
-				main_rooms[id2].n2 = i;
-			} else if (main_rooms[id2].n3 == -1) {
-				main_rooms[id2].n3 = i;
-			}
-		} else if (main_rooms[i].n2 == -1) {
-			main_rooms[i].n2 = id2; // set room i to be linked with id1
-			if (main_rooms[id2].n1 == -1) {
-				main_rooms[id2].n1 = i;
-			} else if (main_rooms[id2].n2 == -1) {
-				main_rooms[id2].n2 = i;
-			} else if (main_rooms[id2].n3 == -1) {
-				main_rooms[id2].n3 = i;
-			}			
-		} else if (main_rooms[i].n3 == -1) {
-			main_rooms[i].n3 = id2; // set room i to be linked with id1
-			if (main_rooms[id2].n1 == -1) {
-				main_rooms[id2].n1 = i;
-			} else if (main_rooms[id2].n2 == -1) {
-				main_rooms[id2].n2 = i;
-			} else if (main_rooms[id2].n3 == -1) {
-				main_rooms[id2].n3 = i;
-			}
+	}
+	int cut_off = 0;
+	for (int i = 0; i < main_geom.n; i++) {
+		int x = (int) (main_geom.x[i] + main_geom.w[i] / 2) - d.x0;
+		int y = (int) (main_geom.y[i] + main_geom.h[i] / 2) - d.y0;
+		if (!seen[(size_t) y * d.w + x]) cut_off++;
+	}
+
+	std::cout << "corridors: " << n_links << " links " << d.w << "x" << d.h
+		<< " tiles raster ms: " << std::chrono::duration<double, std::milli>(t1 - t0).count()
+		<< " carve ms: " << std::chrono::duration<double, std::milli>(t2 - t1).count()
+		<< " rooms: " << main_geom.n << " main " << n_added - main_geom.n << " added"
+		<< " floor tiles: " << tiles << " unreachable: " << cut_off << std::endl;
+	delete[] links;
+	delete[] main_rooms;
+	geom_free(main_geom);
+	geom_free(geom);
+	delete[] rooms;
+}
+
+int main(int argc, char *argv[]) {
+	uint64_t seed = time(NULL); // init random
+
+	// usage: dungeontest [--seed n] [--link-nearest] [--bench-separate [n]]
+	//   [--bench-link [n]] [--bench-knn [n]] [--bench-corridors [n]]
+	bool link_nearest = false;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			seed = strtoull(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--bench-separate") == 0) {
+			int n = 50000;
+			if (i + 1 < argc) n = strtol(argv[i + 1], NULL, 10);
+			srand(seed);
+			run_separate_bench(n);
+			return 0;
+		} else if (strcmp(argv[i], "--bench-link") == 0) {
+			int n = 100000;
+			if (i + 1 < argc) n = strtol(argv[i + 1], NULL, 10);
+			srand(seed);
+			run_link_bench(n);
+			return 0;
+		} else if (strcmp(argv[i], "--bench-knn") == 0) {
+			int n = 100000;
+			if (i + 1 < argc) n = strtol(argv[i + 1], NULL, 10);
+			srand(seed);
+			run_knn_bench(n);
+			return 0;
+		} else if (strcmp(argv[i], "--bench-corridors") == 0) {
+			int n = 100000;
+			if (i + 1 < argc) n = strtol(argv[i + 1], NULL, 10);
+			srand(seed);
+			run_corridor_bench(n);
+			return 0;
+		} else if (strcmp(argv[i], "--link-nearest") == 0) {
+			link_nearest = true;
 		}
-		
-		links[top_link_idx++] = {global_uuid_idx++, i, id2, d2};
 	}
+	srand(seed);
 	
-	// clean up
-	{ // array resize hack : the sequel
-		graph_edge_t* n = new graph_edge_t[top_link_idx];
-		memcpy(n, links, top_link_idx * sizeof(graph_edge_t));
-		delete[] links;
-		links = n;
-	}
+	room_t* rooms = new room_t[param_n_rooms];
+	room_geom_t geom;
+	geom_init(geom, param_n_rooms);
+	generate_rooms(rooms, geom, param_radius);
 	
-	// flatten rooms 
-	int * grid = new int[param_width * param_n_rooms];
-	for (int i = 0; i < param_width * param_height; i++)
-		grid[i] = 0;
+	// seperate all rooms from each other, this also snaps them to the grid
+	separate_rooms(rooms, geom);
 	
-	for (int i = 0; i < num_main_rooms; i++){
-		for (int x = main_rooms[i].x; x < main_rooms[i].x + main_rooms[i].w; x++){
-			for (int y = main_rooms[i].y; y < main_rooms[i].y + main_rooms[i].h; y++){
-				if (x >= param_width) continue;
-				if (y >= param_height) continue;
-				
-				grid[y * param_width + x] = 1;
-			}
-		}
-	}
+	// add by threshold
+	room_geom_t main_geom;
+	room_t* main_rooms = select_main_rooms(rooms, geom, main_geom);
 	
-	std::cout << "t" << std::endl;
-	// convert links to horizontal and vertical lines of tiles
-	for (int i = 0; i < top_link_idx; i++) {
-		int x = main_rooms[links[i].id_target_a].x;
-		int y = main_rooms[links[i].id_target_a].y;
-		int dx = main_rooms[links[i].id_target_b].x - main_rooms[links[i].id_target_a].x;
-		int dy = main_rooms[links[i].id_target_b].y - main_rooms[links[i].id_target_a].y;
-		
-		for (int j = x; j < x + dx; j++){
-			
-		}
-		
-		for (int j = y; y < y + dy; j++){
-			
-		}
-	}
+	// link rooms together
+	int top_link_idx = 0;
+	graph_edge_t * links = link_nearest ? link_rooms_nearest(main_rooms, main_geom, top_link_idx)
+		: link_rooms(main_geom, param_loops, top_link_idx);
 	
-	// for all links of tiles, if they intersect any rooms, add the rooms to the current structure of valid tiles
+	// convert links to horizontal and vertical lines of tiles. rooms they
+	// run into are added to the dungeon along with the main rooms
+	dungeon_t d;
+	dungeon_init(d, geom);
+	carve_dungeon(d, geom, main_geom, links, top_link_idx);
 
 	// print out dungeon
+	dungeon_print(d);
+	
+	// clean up
+	delete[] links;
+	delete[] main_rooms;
+	geom_free(main_geom);
+	geom_free(geom);
+	delete[] rooms;
 }
\ No newline at end of file
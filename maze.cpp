@@ -0,0 +1,2349 @@
+#include "maze.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <climits>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static char * arena_block(size_t size) {
+	void * p = NULL;
+	if (posix_memalign(&p, 64, std::max(size, (size_t) 64)) != 0) throw std::bad_alloc();
+	return (char *) p;
+}
+
+void arena_init(arena_t & a, size_t cap) {
+	a.base = (cap > 0) ? arena_block(cap) : NULL;
+	a.cap = cap;
+	a.used = 0;
+	a.peak = 0;
+}
+
+void arena_free(arena_t & a) {
+	for (size_t i = 0; i < a.extra.size(); i++)
+		free(a.extra[i]);
+	a.extra.clear();
+	free(a.base);
+	a.base = NULL;
+	a.cap = a.used = a.peak = 0;
+}
+
+void * arena_alloc(arena_t & a, size_t size) {
+	size = (size + 63) & ~(size_t) 63;
+	a.peak += size;
+	if (a.used + size <= a.cap) {
+		void * p = a.base + a.used;
+		a.used += size;
+		return p;
+	}
+	a.extra.push_back(arena_block(size));
+	return a.extra.back();
+}
+
+void arena_reset(arena_t & a) {
+	if (!a.extra.empty()) {
+		// fold everything into one block that fits the whole last round
+		for (size_t i = 0; i < a.extra.size(); i++)
+			free(a.extra[i]);
+		a.extra.clear();
+		free(a.base);
+		a.base = arena_block(a.peak);
+		a.cap = a.peak;
+	}
+	a.used = 0;
+	a.peak = 0;
+}
+
+void arena_reserve(arena_t & a, size_t size) {
+	if (a.used > 0 || !a.extra.empty() || size <= a.cap) return;
+	free(a.base);
+	a.base = arena_block(size);
+	a.cap = size;
+}
+
+void grid_setup(grid_t & g, int gw, int gh, int layout) {
+	g.w = gw;
+	g.h = gh;
+	g.layout = layout;
+	g.shift = 0;
+	g.stride = 0;
+	if (layout == LAYOUT_TILED) {
+		g.stride = (gw + 7) / 8;
+		g.words = g.stride * ((gh + 7) / 8);
+	} else if (layout == LAYOUT_MORTON) {
+		// block side: the smaller dimension rounded up to a power of two,
+		// at most 1024, so padding stays under 2x per dimension
+		int side = std::min(gw, gh);
+		while ((1 << g.shift) < side && g.shift < 10) g.shift++;
+		long long bs = 1LL << g.shift;
+		g.stride = (gw + bs - 1) / bs;
+		g.words = (g.stride * ((gh + bs - 1) / bs) * bs * bs + 63) / 64;
+	} else {
+		g.words = ((long long) gw * gh + 63) / 64;
+	}
+}
+
+void grid_init(grid_t & g, int gw, int gh, int layout) {
+	grid_setup(g, gw, gh, layout);
+	g.east = new uint64_t[g.words]();
+	g.south = new uint64_t[g.words]();
+	g.visited = new uint64_t[g.words]();
+}
+
+void grid_init_arena(grid_t & g, int gw, int gh, int layout, arena_t & a) {
+	grid_setup(g, gw, gh, layout);
+	g.east = arena_array<uint64_t>(a, g.words);
+	g.south = arena_array<uint64_t>(a, g.words);
+	g.visited = arena_array<uint64_t>(a, g.words);
+	grid_clear(g);
+}
+
+void grid_free(grid_t & g) {
+	delete[] g.east;
+	delete[] g.south;
+	delete[] g.visited;
+	g.east = g.south = g.visited = NULL;
+}
+
+void grid_clear(grid_t & g) {
+	memset(g.east, 0, g.words * sizeof(uint64_t));
+	memset(g.south, 0, g.words * sizeof(uint64_t));
+	memset(g.visited, 0, g.words * sizeof(uint64_t));
+}
+
+tile_t get_tile(const grid_t & g, int x, int y) {
+	tile_t t;
+	t.visited = grid_visited(g, x, y);
+	t.n = open_north(g, x, y);
+	t.s = open_south(g, x, y);
+	t.e = open_east(g, x, y);
+	t.w = open_west(g, x, y);
+	t.solid = false;
+	return t;
+}
+
+void ob_init(out_buf_t & ob, FILE * f, size_t cap) {
+	ob.f = f;
+	ob.buf = new char[cap];
+	ob.cap = cap;
+	ob.len = 0;
+}
+
+void ob_flush(out_buf_t & ob) {
+	if (ob.len > 0) fwrite(ob.buf, 1, ob.len, ob.f);
+	ob.len = 0;
+}
+
+void ob_free(out_buf_t & ob) {
+	ob_flush(ob);
+	delete[] ob.buf;
+	ob.buf = NULL;
+}
+
+void render_row(out_buf_t & ob, int rw, const uint64_t * north, const uint64_t * east,
+		const uint64_t * south, const uint64_t * visited, int format) {
+	if (format == RENDER_COMPACT) {
+		static const char hex[] = "0123456789abcdef";
+		char * p = ob_reserve(ob, rw + 1);
+		for (int x = 0; x < rw; x++) {
+			int m = get_bit(east, x) << DIR_E
+				| (x > 0 && get_bit(east, x - 1)) << DIR_W
+				| get_bit(south, x) << DIR_S
+				| get_bit(north, x) << DIR_N;
+			*p++ = hex[m];
+		}
+		*p++ = '\n';
+		ob.len += rw + 1;
+		return;
+	}
+
+	size_t line = 3 + 3 * (size_t) rw + 1;
+	char * a = ob_reserve(ob, 3 * line);
+	char * b = a + line;
+	char * c = b + line;
+	memcpy(a, "A: ", 3);
+	memcpy(b, "B: ", 3);
+	memcpy(c, "C: ", 3);
+	a += 3;
+	b += 3;
+	c += 3;
+	for (int x = 0; x < rw; x++) {
+		a[0] = 'O';
+		a[1] = get_bit(north, x) ? ' ' : '#';
+		a[2] = 'O';
+		b[0] = (x > 0 && get_bit(east, x - 1)) ? ' ' : '#';
+		b[1] = (visited == NULL || get_bit(visited, x)) ? ' ' : '#';
+		b[2] = get_bit(east, x) ? ' ' : '#';
+		c[0] = 'O';
+		c[1] = get_bit(south, x) ? ' ' : '#';
+		c[2] = 'O';
+		a += 3;
+		b += 3;
+		c += 3;
+	}
+	*a = '\n';
+	*b = '\n';
+	*c = '\n';
+	ob.len += 3 * line;
+}
+
+void grid_row(const grid_t & g, const uint64_t * plane, int y, uint64_t * row) {
+	if (g.layout == LAYOUT_ROWS) {
+		long long i = grid_idx(g, 0, y);
+		for (int x = 0; x < g.w; x += 64)
+			row[x >> 6] = get_bits(plane, i + x, std::min(64, g.w - x));
+		return;
+	}
+
+	memset(row, 0, ((g.w + 63) / 64) * sizeof(uint64_t));
+	for (int x = 0; x < g.w; x++) {
+		if (get_bit(plane, grid_idx(g, x, y))) set_bit(row, x);
+	}
+}
+
+void render_grid(out_buf_t & ob, const grid_t & g, uint64_t * rows, int format) {
+	long long words = (g.w + 63) / 64;
+	uint64_t * north = rows;
+	uint64_t * east = rows + words;
+	uint64_t * south = rows + 2 * words;
+	uint64_t * visited = rows + 3 * words;
+
+	memset(north, 0, words * sizeof(uint64_t));
+	for (int y = 0; y < g.h; y++) {
+		grid_row(g, g.east, y, east);
+		grid_row(g, g.south, y, south);
+		if (g.visited != NULL) grid_row(g, g.visited, y, visited);
+		render_row(ob, g.w, north, east, south, (g.visited != NULL) ? visited : NULL, format);
+		std::swap(north, south);
+	}
+}
+
+size_t render_size(int rw, int rh, int format) {
+	if (format == RENDER_COMPACT) return (size_t) rh * (rw + 1);
+	return (size_t) rh * 3 * (3 + 3 * (size_t) rw + 1);
+}
+
+void render_maze(const grid_t & g, FILE * f, int format) {
+	uint64_t * rows = new uint64_t[4 * ((g.w + 63) / 64)];
+
+	out_buf_t ob;
+	ob_init(ob, f, 1 << 20);
+	ob_puts(ob, "maze:\n");
+	render_grid(ob, g, rows, format);
+	ob_puts(ob, "done.\n");
+	ob_free(ob);
+	fflush(f);
+
+	delete[] rows;
+}
+
+void print_maze(const grid_t & g, int format) {
+	std::cout.flush();
+	render_maze(g, stdout, format);
+}
+
+void print_visited(const grid_t & g) {
+	std::cout << "visited:" << std::endl;
+	for (int y = 0; y < g.h; y++){
+		for (int x = 0; x < g.w; x++){
+			std::cout << grid_visited(g, x, y);
+		}
+		std::cout << std::endl;
+	}
+	std::cout << "done.";
+}
+
+void rng_seed(rng_t & r, uint64_t seed) {
+	// expand the seed with splitmix64 so similar seeds give unrelated states
+	for (int i = 0; i < 4; i++) {
+		seed += 0x9E3779B97F4A7C15ULL;
+		r.s[i] = mix_seed(seed);
+	}
+	r.draws = 0;
+}
+
+void dstk_init(dir_stack_t & st, arena_t * arena) {
+	st.size = 0;
+	st.arena = arena;
+}
+
+void dstk_free(dir_stack_t & st) {
+	if (st.arena == NULL) {
+		for (size_t i = 0; i < st.chunks.size(); i++)
+			delete[] st.chunks[i];
+	}
+	st.chunks.clear();
+	st.size = 0;
+}
+
+void stats_clear(gen_stats_t & st) {
+	memset(&st, 0, sizeof(st));
+}
+
+void scratch_init(maze_scratch_t & sc, arena_t & arena) {
+	sc.arena = &arena;
+	dstk_init(sc.stk, &arena);
+}
+
+void scratch_free(maze_scratch_t & sc) {
+	dstk_free(sc.stk);
+	sc.arena = NULL;
+}
+
+void scratch_reset(maze_scratch_t & sc) {
+	dstk_free(sc.stk); // clear() keeps the chunk table's capacity
+	arena_reset(*sc.arena);
+}
+
+long long generate_maze(grid_t & g, dir_stack_t & stk, int sx, int sy, rng_t & rng,
+		gen_stats_t * stats) {
+	long long remaining = (long long) g.w * g.h;
+	int cx = sx;
+	int cy = sy;
+
+	grid_set_visited(g, cx, cy);
+	remaining--;
+
+	long long cycle = 0;
+	long long backtracks = 0;
+	long long max_depth = 0;
+	while (remaining > 0) {
+		cycle++;
+
+		// get unvisited neighbors
+		int m = neighbor_mask(g, cx, cy, false);
+		if (m == 0) { // dead end
+			if (stk.size == 0) break;
+
+			// pop stack and walk back the way we came
+			step(cx, cy, dstk_pop(stk) ^ 1);
+			backtracks++;
+			continue;
+		}
+
+		// choose random neighbor, connect current to it and make it current
+		int idx = pick_dir(m, rng);
+		carve(g, cx, cy, idx);
+		step(cx, cy, idx);
+
+		grid_set_visited(g, cx, cy);
+		remaining--;
+
+		// remember how we got here
+		dstk_push(stk, idx);
+		max_depth = std::max(max_depth, stk.size);
+	}
+
+	if (stats != NULL) {
+		stats->steps += cycle;
+		stats->backtracks += backtracks;
+		stats->max_depth = std::max(stats->max_depth, max_depth);
+	}
+
+	// leave the stack empty for the next caller
+	stk.size = 0;
+	return cycle;
+}
+
+// the lane kernel works on a LANE_STRIDE x LANE_STRIDE board: the maze plus
+// a ring of border cells, so neighbors never need a bounds check. a board
+// cell holds 0 while unvisited, otherwise the direction that reached it + 1.
+// cells are interleaved lane by lane, cell c of lane l at c * MAZE_LANES + l
+static const int LANE_STRIDE = LANE_MAX_SIDE + 2;
+static const int LANE_DUMMY = LANE_STRIDE * LANE_STRIDE; // sink for idle lanes' stores
+static const int LANE_CELLS = LANE_DUMMY + 1;
+static const uint32_t LANE_ROOT = 5;
+static const uint32_t LANE_BORDER = 8;
+
+// ctz of every 4 bit mask, 2 bits each
+static const uint32_t LANE_CTZ4 = 0x12131210;
+
+// GCC vector extensions, so the arithmetic is one AVX2 register per group
+// in the avx2 kernel and a pair of SSE2 ones otherwise. the lanes are
+// worked in groups of LANE_WIDTH whose steps are independent, so each
+// group's gathers overlap with the other groups' arithmetic
+static const int LANE_WIDTH = 8;
+static const int LANE_GROUPS = MAZE_LANES / LANE_WIDTH;
+typedef uint32_t lane_u32 __attribute__((vector_size(4 * LANE_WIDTH)));
+
+struct lane_job_t {
+	uint32_t * board;           // LANE_CELLS * MAZE_LANES
+	lane_u32 cur[LANE_GROUPS];  // board cell each lane is at
+	lane_u32 left[LANE_GROUPS]; // cells each lane has still to visit
+	lane_u32 s[LANE_GROUPS][4]; // xoshiro128** state, one stream per lane
+};
+
+// loads p[idx[l]] into lane l of v. the portable one goes a lane at a
+// time. vectors go by reference, by value they'd change the ABI with -mavx
+struct lane_gather_t {
+	static inline void load(lane_u32 & v, const uint32_t * p, const lane_u32 & idx) {
+		for (int l = 0; l < LANE_WIDTH; l++)
+			v[l] = p[idx[l]];
+	}
+};
+
+#if defined(__x86_64__)
+struct lane_gather_avx2_t {
+	__attribute__((target("avx2"))) static inline void load(lane_u32 & v, const uint32_t * p, const lane_u32 & idx) {
+		v = (lane_u32) _mm256_i32gather_epi32((const int *) p, (__m256i) idx, 4);
+	}
+};
+#endif
+
+// one step of every lane in group gi
+template <class G> static inline void lanes_step(lane_job_t & job, int gi) {
+	const int L = MAZE_LANES;
+	const lane_u32 zero = {};
+	const lane_u32 one = zero + 1;
+	const lane_u32 stride = zero + LANE_STRIDE;
+	const lane_u32 dummy = zero + LANE_DUMMY;
+	const lane_u32 lane = {0, 1, 2, 3, 4, 5, 6, 7};
+	uint32_t * board = job.board + gi * LANE_WIDTH;
+	lane_u32 cur = job.cur[gi];
+	lane_u32 live = (lane_u32) (job.left[gi] != 0);
+	lane_u32 * s = job.s[gi];
+
+	lane_u32 r = s[1] * 5;
+	r = ((r << 7) | (r >> 25)) * 9;
+	lane_u32 t = s[1] << 9;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = (s[3] << 11) | (s[3] >> 21);
+
+	// the four neighbors and the cell itself
+	lane_u32 at = cur * L + lane;
+	lane_u32 e, w, so, n, self;
+	G::load(e, board + L, at);
+	G::load(w, board - L, at);
+	G::load(so, board + LANE_STRIDE * L, at);
+	G::load(n, board - LANE_STRIDE * L, at);
+	G::load(self, board, at);
+
+	// pick the k-th unvisited neighbor: drop the k lowest set bits of the
+	// mask, then take the lowest one left
+	lane_u32 m = ((lane_u32) (e == 0) & 1) | ((lane_u32) (w == 0) & 2)
+		| ((lane_u32) (so == 0) & 4) | ((lane_u32) (n == 0) & 8);
+	lane_u32 cnt = (m & 1) + ((m >> 1) & 1) + ((m >> 2) & 1) + (m >> 3);
+	lane_u32 k = ((r >> 2) * cnt) >> 30;
+	lane_u32 mk = m;
+	mk = (k > 0) ? mk & (mk - 1) : mk;
+	mk = (k > 1) ? mk & (mk - 1) : mk;
+	mk = (k > 2) ? mk & (mk - 1) : mk;
+	lane_u32 ahead = (LANE_CTZ4 >> (2 * mk)) & 3;
+
+	// no unvisited neighbor: step back the way we came in
+	lane_u32 fwd = (lane_u32) (cnt != 0) & live;
+	lane_u32 back = ((self - 1) ^ 1) & 3;
+	lane_u32 d = (fwd != 0) ? ahead : back;
+	lane_u32 off = ((d & 2) != 0) ? stride : one;
+	lane_u32 next = ((d & 1) != 0) ? cur - off : cur + off;
+	cur = (live != 0) ? next : cur;
+	job.cur[gi] = cur;
+	job.left[gi] -= fwd & 1;
+
+	// there is no scatter in AVX2. lanes going back or idling store into
+	// the dummy cell
+	at = ((fwd != 0) ? cur : dummy) * L + lane;
+	for (int l = 0; l < LANE_WIDTH; l++)
+		board[at[l]] = d[l] + 1;
+}
+
+template <class G> static inline long long lanes_run(lane_job_t & job) {
+	long long cycle = 0;
+	while (true) {
+		lane_u32 live = {};
+		for (int gi = 0; gi < LANE_GROUPS; gi++)
+			live |= job.left[gi];
+		uint32_t any = 0;
+		for (int l = 0; l < LANE_WIDTH; l++)
+			any |= live[l];
+		if (any == 0) break;
+		cycle++;
+		for (int gi = 0; gi < LANE_GROUPS; gi++)
+			lanes_step<G>(job, gi);
+	}
+	return cycle;
+}
+
+#if defined(__x86_64__)
+// flatten pulls the avx2 gathers in through lanes_run and lanes_step
+__attribute__((target("avx2"), flatten)) static long long lanes_carve_avx2(lane_job_t & job) {
+	return lanes_run<lane_gather_avx2_t>(job);
+}
+#endif
+
+static long long lanes_carve(lane_job_t & job) {
+#if defined(__x86_64__)
+	if (__builtin_cpu_supports("avx2")) return lanes_carve_avx2(job);
+#endif
+	return lanes_run<lane_gather_t>(job);
+}
+
+// write the passages recorded in lane l of board into g
+static void lanes_store(const uint32_t * board, int l, grid_t & g) {
+	const int L = MAZE_LANES;
+	for (int y = 0; y < g.h; y++) {
+		const uint32_t * row = board + ((y + 1) * LANE_STRIDE + 1) * L + l;
+		uint32_t er = 0;
+		uint32_t sr = 0;
+		for (int x = 0; x < g.w; x++) {
+			uint32_t v = row[x * L];
+			er |= (uint32_t) ((v == DIR_W + 1) | (row[(x + 1) * L] == DIR_E + 1)) << x;
+			sr |= (uint32_t) ((v == DIR_N + 1) | (row[(x + LANE_STRIDE) * L] == DIR_S + 1)) << x;
+		}
+		if (g.layout == LAYOUT_ROWS) {
+			long long i = (long long) y * g.w;
+			uint64_t * pe = g.east + (i >> 6);
+			uint64_t * ps = g.south + (i >> 6);
+			int off = i & 63;
+			pe[0] |= (uint64_t) er << off;
+			ps[0] |= (uint64_t) sr << off;
+			if (off + g.w > 64) {
+				pe[1] |= (uint64_t) er >> (64 - off);
+				ps[1] |= (uint64_t) sr >> (64 - off);
+			}
+		} else {
+			for (int x = 0; x < g.w; x++) {
+				if ((er >> x) & 1) set_bit(g.east, grid_idx(g, x, y));
+				if ((sr >> x) & 1) set_bit(g.south, grid_idx(g, x, y));
+			}
+		}
+	}
+	memset(g.visited, 0xFF, g.words * sizeof(uint64_t));
+}
+
+long long generate_maze_lanes(grid_t * grids, int n, const uint64_t * seeds, maze_scratch_t * scratch) {
+	const int L = MAZE_LANES;
+	if (n < 1 || n > L) return -1;
+	int w = grids[0].w;
+	int h = grids[0].h;
+	// a side over LANE_MAX_SIDE would leave the border ring inside the maze
+	if (w < 1 || w > LANE_MAX_SIDE || h < 1 || h > LANE_MAX_SIDE) return -1;
+	for (int l = 1; l < n; l++) {
+		if (grids[l].w != w || grids[l].h != h) return -1;
+	}
+
+	uint32_t * board = scratch_array<uint32_t>(scratch, LANE_CELLS * L);
+	for (int c = 0; c < LANE_CELLS; c++) {
+		int x = c % LANE_STRIDE - 1;
+		int y = c / LANE_STRIDE - 1;
+		bool inside = (x >= 0 && x < w && y >= 0 && y < h);
+		for (int l = 0; l < L; l++)
+			board[c * L + l] = inside ? 0 : LANE_BORDER;
+	}
+
+	// lanes past n carve a throwaway maze from seed 0
+	lane_job_t job;
+	job.board = board;
+	for (int l = 0; l < L; l++) {
+		rng_t rng;
+		rng_seed(rng, (l < n) ? seeds[l] : 0);
+		int sx = rng_range(rng, w);
+		int sy = rng_range(rng, h);
+		uint64_t a = rng_next(rng);
+		uint64_t b = rng_next(rng);
+		int gi = l / LANE_WIDTH;
+		int li = l % LANE_WIDTH;
+		job.s[gi][0][li] = (uint32_t) a;
+		job.s[gi][1][li] = (uint32_t) (a >> 32);
+		job.s[gi][2][li] = (uint32_t) b;
+		job.s[gi][3][li] = (uint32_t) (b >> 32);
+		job.cur[gi][li] = (sy + 1) * LANE_STRIDE + sx + 1;
+		job.left[gi][li] = w * h - 1;
+		board[((sy + 1) * LANE_STRIDE + sx + 1) * L + l] = LANE_ROOT;
+	}
+
+	long long cycle = lanes_carve(job);
+	for (int l = 0; l < n; l++)
+		lanes_store(board, l, grids[l]);
+	scratch_release(scratch, board);
+	return cycle;
+}
+
+// atomically or the low n <= 64 bits of v into p starting at bit i. used
+// when several threads write cells that share a word
+static inline void or_bits_atomic(uint64_t * p, long long i, uint64_t v, int n) {
+	int off = i & 63;
+	if (v == 0) return;
+	__atomic_fetch_or(&p[i >> 6], v << off, __ATOMIC_RELAXED);
+	if (off + n > 64) __atomic_fetch_or(&p[(i >> 6) + 1], v >> (64 - off), __ATOMIC_RELAXED);
+}
+
+// or n bits of plane src starting at bit si into plane dst at bit di
+static void copy_bits_atomic(uint64_t * dst, long long di, const uint64_t * src, long long si, int n) {
+	for (int k = 0; k < n; k += 64) {
+		int c = (n - k < 64) ? n - k : 64;
+		or_bits_atomic(dst, di + k, get_bits(src, si + k, c), c);
+	}
+}
+
+// shared state for the tile workers
+struct tile_job_t {
+	grid_t * g;
+	int tile;
+	int tiles_x;
+	int tiles_y;
+	uint64_t seed;
+	std::atomic<int> next;
+	gen_stats_t * stats; // NULL if nobody is counting
+	std::mutex stats_lock;
+};
+
+// worker: take tiles off the shared counter, carve each one into a private
+// tile sized grid with its own rng stream and copy the result into the
+// shared grid. tiles never open walls across their edges, that is left to
+// the seam pass.
+static void tile_worker(tile_job_t * job) {
+	grid_t & g = *job->g;
+	grid_t local;
+	grid_init(local, job->tile, job->tile);
+	dir_stack_t stk;
+	dstk_init(stk);
+	gen_stats_t st;
+	stats_clear(st);
+
+	int n_tiles = job->tiles_x * job->tiles_y;
+	for (int t = job->next++; t < n_tiles; t = job->next++) {
+		int x0 = (t % job->tiles_x) * job->tile;
+		int y0 = (t / job->tiles_x) * job->tile;
+		int tw = std::min(job->tile, g.w - x0);
+		int th = std::min(job->tile, g.h - y0);
+
+		// reuse the local grid, shrunk to this tile
+		local.w = tw;
+		local.h = th;
+		grid_clear(local);
+
+		rng_t rng;
+		rng_seed(rng, mix_seed(job->seed) ^ (uint64_t) t);
+		generate_maze(local, stk, rng_range(rng, tw), rng_range(rng, th), rng, &st);
+		st.rng_draws += rng.draws;
+
+		for (int ly = 0; ly < th; ly++) {
+			if (g.layout == LAYOUT_ROWS) {
+				long long di = grid_idx(g, x0, y0 + ly);
+				long long si = grid_idx(local, 0, ly);
+				copy_bits_atomic(g.east, di, local.east, si, tw);
+				copy_bits_atomic(g.south, di, local.south, si, tw);
+				copy_bits_atomic(g.visited, di, local.visited, si, tw);
+				continue;
+			}
+
+			// other layouts aren't contiguous along a row, go cell by cell
+			for (int lx = 0; lx < tw; lx++) {
+				long long di = grid_idx(g, x0 + lx, y0 + ly);
+				or_bits_atomic(g.east, di, open_east(local, lx, ly), 1);
+				or_bits_atomic(g.south, di, open_south(local, lx, ly), 1);
+				or_bits_atomic(g.visited, di, 1, 1);
+			}
+		}
+	}
+
+	if (job->stats != NULL) {
+		std::lock_guard<std::mutex> lock(job->stats_lock);
+		job->stats->steps += st.steps;
+		job->stats->backtracks += st.backtracks;
+		job->stats->max_depth = std::max(job->stats->max_depth, st.max_depth);
+		job->stats->rng_draws += st.rng_draws;
+	}
+
+	grid_free(local);
+	dstk_free(stk);
+}
+
+bool generate_maze_parallel(grid_t & g, int tile, int n_threads, uint64_t seed,
+		gen_stats_t * stats) {
+	if (tile < 1 || n_threads < 1) return false;
+
+	tile_job_t job;
+	job.g = &g;
+	job.tile = tile;
+	job.tiles_x = (g.w + tile - 1) / tile;
+	job.tiles_y = (g.h + tile - 1) / tile;
+	job.seed = seed;
+	job.next = 0;
+	job.stats = stats;
+
+	std::vector<std::thread> workers;
+	for (int i = 0; i < n_threads; i++)
+		workers.push_back(std::thread(tile_worker, &job));
+	for (int i = 0; i < n_threads; i++)
+		workers[i].join();
+
+	// stitch seams
+	grid_t tg;
+	grid_init(tg, job.tiles_x, job.tiles_y);
+	dir_stack_t stk;
+	dstk_init(stk);
+	rng_t rng;
+	rng_seed(rng, mix_seed(seed) ^ 0xFFFFFFFFFFFFFFFFULL);
+	generate_maze(tg, stk, 0, 0, rng);
+
+	for (int ty = 0; ty < job.tiles_y; ty++) {
+		for (int tx = 0; tx < job.tiles_x; tx++) {
+			int x0 = tx * tile;
+			int y0 = ty * tile;
+			if (open_east(tg, tx, ty)) {
+				// seam between this tile and the one to the east
+				int th = std::min(tile, g.h - y0);
+				carve(g, x0 + tile - 1, y0 + (int) rng_range(rng, th), DIR_E);
+			}
+			if (open_south(tg, tx, ty)) {
+				int tw = std::min(tile, g.w - x0);
+				carve(g, x0 + (int) rng_range(rng, tw), y0 + tile - 1, DIR_S);
+			}
+		}
+	}
+
+	if (stats != NULL) stats->rng_draws += rng.draws;
+
+	grid_free(tg);
+	dstk_free(stk);
+	return true;
+}
+
+// swap the bits of v whose index has bit i set and bit j clear with the
+// ones d = 2^j - 2^i above them. m marks the lower bit of each pair
+static inline uint64_t delta_swap(uint64_t v, uint64_t m, int d) {
+	uint64_t t = ((v >> d) ^ v) & m;
+	return v ^ t ^ (t << d);
+}
+
+// an aligned 8 x 8 square of a morton block is one word with bit index
+// y2 x2 y1 x1 y0 x0. reorder it to y2 y1 y0 x2 x1 x0 as in LAYOUT_TILED
+static inline uint64_t morton_to_tile(uint64_t v) {
+	v = delta_swap(v, 0x0C0C0C0C0C0C0C0CULL, 2);  // swap y0, x1
+	v = delta_swap(v, 0x0000F0F00000F0F0ULL, 12); // swap y0, x2
+	return delta_swap(v, 0x0000FF000000FF00ULL, 8); // swap y1, y0
+}
+
+// regroup the east and south planes of g into 8 x 8 blocks, one word per
+// block with bit (y & 7) * 8 + (x & 7), blocks in row order. this is the
+// LAYOUT_TILED order. morton blocks of side 8 and up already hold whole
+// squares per word; anything else is gathered a row of words at a time
+static void tile_planes(const grid_t & g, uint64_t * te, uint64_t * ts) {
+	long long bw = (g.w + 7) / 8;
+	long long bh = (g.h + 7) / 8;
+	long long rwords = (g.w + 63) / 64;
+
+	if (g.layout == LAYOUT_MORTON && g.shift >= 3) {
+		for (long long by = 0; by < bh; by++) {
+			for (long long bx = 0; bx < bw; bx++) {
+				long long i = grid_idx(g, bx * 8, by * 8) >> 6;
+				te[by * bw + bx] = morton_to_tile(g.east[i]);
+				ts[by * bw + bx] = morton_to_tile(g.south[i]);
+			}
+		}
+		return;
+	}
+
+	uint64_t * rows = new uint64_t[16 * rwords];
+
+	for (long long by = 0; by < bh; by++) {
+		for (int ry = 0; ry < 8; ry++) {
+			uint64_t * re = rows + ry * rwords;
+			uint64_t * rs = rows + (8 + ry) * rwords;
+			int y = by * 8 + ry;
+			if (y < g.h) {
+				grid_row(g, g.east, y, re);
+				grid_row(g, g.south, y, rs);
+			} else {
+				memset(re, 0, rwords * sizeof(uint64_t));
+				memset(rs, 0, rwords * sizeof(uint64_t));
+			}
+		}
+		for (long long bx = 0; bx < bw; bx++) {
+			uint64_t e = 0;
+			uint64_t s = 0;
+			int shift = (bx & 7) * 8;
+			for (int ry = 0; ry < 8; ry++) {
+				e |= ((rows[ry * rwords + (bx >> 3)] >> shift) & 0xFF) << (ry * 8);
+				s |= ((rows[(8 + ry) * rwords + (bx >> 3)] >> shift) & 0xFF) << (ry * 8);
+			}
+			te[by * bw + bx] = e;
+			ts[by * bw + bx] = s;
+		}
+	}
+
+	delete[] rows;
+}
+
+bool verify_maze(const grid_t & g, verify_result_t * res) {
+	verify_result_t r;
+	r.cells = (long long) g.w * g.h;
+	r.edges = 0;
+	r.leaks = 0;
+	r.reached = 0;
+
+	for (long long i = 0; i < g.words; i++)
+		r.edges += __builtin_popcountll(g.east[i]) + __builtin_popcountll(g.south[i]);
+	for (int y = 0; y < g.h; y++)
+		r.leaks += open_east(g, g.w - 1, y);
+	for (int x = 0; x < g.w; x++)
+		r.leaks += open_south(g, x, g.h - 1);
+
+	if (r.leaks == 0 && r.edges == r.cells - 1) {
+		const uint64_t COL0 = 0x0101010101010101ULL;
+		const uint64_t COL7 = COL0 << 7;
+		const uint64_t ROW0 = 0xFFULL;
+		const uint64_t ROW7 = ROW0 << 56;
+
+		long long bw = (g.w + 7) / 8;
+		long long bh = (g.h + 7) / 8;
+		long long blocks = bw * bh;
+		const uint64_t * te = g.east;
+		const uint64_t * ts = g.south;
+		uint64_t * tiled = NULL;
+		if (g.layout != LAYOUT_TILED) {
+			tiled = new uint64_t[2 * blocks];
+			tile_planes(g, tiled, tiled + blocks);
+			te = tiled;
+			ts = tiled + blocks;
+		}
+
+		uint64_t * reach = new uint64_t[blocks]();
+		uint64_t * queued = new uint64_t[(blocks + 63) / 64]();
+		long long * queue = new long long[blocks]; // ring, each block at most once
+		long long head = 0;
+		long long count = 0;
+
+		reach[0] = 1;
+		queue[0] = 0;
+		set_bit(queued, 0);
+		count = 1;
+
+		while (count > 0) {
+			long long b = queue[head];
+			head = (head + 1 == blocks) ? 0 : head + 1;
+			count--;
+			queued[b >> 6] &= ~((uint64_t) 1 << (b & 63));
+
+			// flood inside the block
+			uint64_t e = te[b];
+			uint64_t s = ts[b];
+			uint64_t in_e = e & ~COL7; // east passages that stay in the block
+			uint64_t in_s = s & ~ROW7;
+			uint64_t cur = reach[b];
+			uint64_t prev;
+			do {
+				prev = cur;
+				cur |= ((cur & in_e) << 1) | ((cur >> 1) & in_e);
+				cur |= ((cur & in_s) << 8) | ((cur >> 8) & in_s);
+			} while (cur != prev);
+			reach[b] = cur;
+
+			// push across the edges
+			long long bx = b % bw;
+			long long by = b / bw;
+			long long nb[4];
+			uint64_t seed[4];
+			int k = 0;
+			if (bx + 1 < bw) {
+				nb[k] = b + 1;
+				seed[k++] = (cur & e & COL7) >> 7;
+			}
+			if (bx > 0) {
+				nb[k] = b - 1;
+				seed[k++] = ((cur & COL0) << 7) & te[b - 1];
+			}
+			if (by + 1 < bh) {
+				nb[k] = b + bw;
+				seed[k++] = (cur & s & ROW7) >> 56;
+			}
+			if (by > 0) {
+				nb[k] = b - bw;
+				seed[k++] = ((cur & ROW0) << 56) & ts[b - bw];
+			}
+			for (int j = 0; j < k; j++) {
+				uint64_t add = seed[j] & ~reach[nb[j]];
+				if (add == 0) continue;
+				reach[nb[j]] |= add;
+				if (get_bit(queued, nb[j])) continue;
+				set_bit(queued, nb[j]);
+				long long tail = head + count;
+				if (tail >= blocks) tail -= blocks;
+				queue[tail] = nb[j];
+				count++;
+			}
+		}
+
+		for (long long i = 0; i < blocks; i++)
+			r.reached += __builtin_popcountll(reach[i]);
+
+		delete[] tiled;
+		delete[] reach;
+		delete[] queued;
+		delete[] queue;
+	}
+
+	if (res != NULL) *res = r;
+	return r.leaks == 0 && r.edges == r.cells - 1 && r.reached == r.cells;
+}
+
+void generate_maze_stream(int rw, long long rows, row_sink_t sink, void * user, rng_t & rng, maze_scratch_t * scratch) {
+	long long words = (rw + 63) / 64;
+	uint64_t * east = scratch_array<uint64_t>(scratch, words);
+	uint64_t * south = scratch_array<uint64_t>(scratch, words);
+
+	// set label for each cell of the current row. labels are compacted to
+	// [0, rw) between rows so fresh ones can be taken from [rw, 2 * rw)
+	int * label = scratch_array<int>(scratch, rw);
+	int * parent = scratch_array<int>(scratch, 2 * rw); // union find over labels, current row only
+	int * remap = scratch_array<int>(scratch, 2 * rw);
+	int * left = scratch_array<int>(scratch, 2 * rw);   // cells of a set not yet considered for a drop
+	bool * dropped = scratch_array<bool>(scratch, 2 * rw);
+
+	for (int x = 0; x < rw; x++)
+		label[x] = -1;
+
+	for (long long y = 0; y < rows; y++) {
+		bool last = (y == rows - 1);
+		memset(east, 0, words * sizeof(uint64_t));
+		memset(south, 0, words * sizeof(uint64_t));
+
+		// cells not joined from above start in their own set
+		int fresh = rw;
+		for (int x = 0; x < rw; x++) {
+			if (label[x] < 0) label[x] = fresh++;
+		}
+		for (int i = 0; i < 2 * rw; i++)
+			parent[i] = i;
+
+		// randomly join adjacent cells in different sets, the last row
+		// joins all of them so the maze ends up connected
+		for (int x = 0; x + 1 < rw; x++) {
+			int a = label[x];
+			while (parent[a] != a) a = parent[a] = parent[parent[a]];
+			int b = label[x + 1];
+			while (parent[b] != b) b = parent[b] = parent[parent[b]];
+
+			if (a != b && (last || (rng_next(rng) & 1))) {
+				parent[b] = a;
+				set_bit(east, x);
+			}
+		}
+		for (int x = 0; x < rw; x++) {
+			int a = label[x];
+			while (parent[a] != a) a = parent[a] = parent[parent[a]];
+			label[x] = a;
+		}
+
+		if (!last) {
+			// every set must drop at least one cell into the next row, force
+			// the last cell of a set down if none of the others went
+			for (int i = 0; i < 2 * rw; i++) {
+				left[i] = 0;
+				dropped[i] = false;
+			}
+			for (int x = 0; x < rw; x++)
+				left[label[x]]++;
+
+			for (int x = 0; x < rw; x++) {
+				int s = label[x];
+				left[s]--;
+				if ((rng_next(rng) & 1) || (left[s] == 0 && !dropped[s])) {
+					dropped[s] = true;
+					set_bit(south, x);
+				} else {
+					label[x] = -1;
+				}
+			}
+
+			// compact surviving labels back into [0, rw)
+			for (int i = 0; i < 2 * rw; i++)
+				remap[i] = -1;
+			int next = 0;
+			for (int x = 0; x < rw; x++) {
+				if (label[x] < 0) continue;
+				if (remap[label[x]] < 0) remap[label[x]] = next++;
+				label[x] = remap[label[x]];
+			}
+		}
+
+		sink(y, rw, east, south, user);
+	}
+
+	scratch_release(scratch, east);
+	scratch_release(scratch, south);
+	scratch_release(scratch, label);
+	scratch_release(scratch, parent);
+	scratch_release(scratch, remap);
+	scratch_release(scratch, left);
+	scratch_release(scratch, dropped);
+}
+
+void ascii_sink(long long y, int rw, const uint64_t * east, const uint64_t * south, void * user) {
+	ascii_sink_t * st = (ascii_sink_t *) user;
+	long long words = (rw + 63) / 64;
+	if (y == 0) {
+		ob_puts(st->ob, "maze:\n");
+		memset(st->north, 0, words * sizeof(uint64_t));
+	}
+
+	render_row(st->ob, rw, st->north, east, south, NULL, st->format);
+
+	memcpy(st->north, south, words * sizeof(uint64_t));
+	if (y == st->rows - 1) {
+		ob_puts(st->ob, "done.\n");
+		ob_flush(st->ob);
+	}
+}
+
+bool bmp_maze_begin(bmp_maze_t & bm, std::string fn, int mw, long long rows, int cell, int wall) {
+	bm.w = mw;
+	bm.rows = rows;
+	bm.cell = cell;
+	bm.wall = wall;
+	long long img_w = (long long) mw * (cell + wall) + wall;
+	long long img_h = rows * (cell + wall) + wall;
+	// the header holds 32 bit sizes, and the height goes in negated
+	if (rows < 0 || img_w > INT32_MAX || img_h > INT32_MAX) return false;
+	if (!bitmap_begin(bm.bs, fn, (unsigned int) img_w, (unsigned int) img_h)) return false;
+
+	int span = std::max(cell, wall);
+	bm.line = new unsigned char[3 * (size_t) img_w];
+	bm.wall_px = new unsigned char[3 * span];
+	bm.floor_px = new unsigned char[3 * span];
+	memset(bm.wall_px, 0x00, 3 * span);
+	memset(bm.floor_px, 0xFF, 3 * span);
+	bm.north = new uint64_t[(mw + 63) / 64]();
+	return true;
+}
+
+// append n pixels of wall or floor to the scanline at p
+static inline unsigned char * bmp_span(const bmp_maze_t & bm, unsigned char * p, int n, bool open) {
+	memcpy(p, open ? bm.floor_px : bm.wall_px, 3 * n);
+	return p + 3 * n;
+}
+
+// wall band above a row of cells: corners and the north walls
+static void bmp_wall_band(bmp_maze_t & bm, const uint64_t * north) {
+	unsigned char * p = bm.line;
+	for (int x = 0; x < bm.w; x++) {
+		p = bmp_span(bm, p, bm.wall, false);
+		p = bmp_span(bm, p, bm.cell, north != NULL && get_bit(north, x));
+	}
+	bmp_span(bm, p, bm.wall, false);
+	for (int i = 0; i < bm.wall; i++)
+		bitmap_write_row(bm.bs, bm.line);
+}
+
+void bmp_maze_row(bmp_maze_t & bm, const uint64_t * north, const uint64_t * east) {
+	bmp_wall_band(bm, north);
+
+	unsigned char * p = bm.line;
+	for (int x = 0; x < bm.w; x++) {
+		p = bmp_span(bm, p, bm.wall, x > 0 && get_bit(east, x - 1));
+		p = bmp_span(bm, p, bm.cell, true);
+	}
+	bmp_span(bm, p, bm.wall, false);
+	for (int i = 0; i < bm.cell; i++)
+		bitmap_write_row(bm.bs, bm.line);
+}
+
+void bmp_maze_end(bmp_maze_t & bm) {
+	bmp_wall_band(bm, NULL);
+	bitmap_end(bm.bs);
+	delete[] bm.line;
+	delete[] bm.wall_px;
+	delete[] bm.floor_px;
+	delete[] bm.north;
+}
+
+void bmp_sink(long long y, int rw, const uint64_t * east, const uint64_t * south, void * user) {
+	bmp_maze_t * bm = (bmp_maze_t *) user;
+	bmp_maze_row(*bm, bm->north, east);
+	memcpy(bm->north, south, ((rw + 63) / 64) * sizeof(uint64_t));
+	if (y == bm->rows - 1) bmp_maze_end(*bm);
+}
+
+bool render_bmp(const grid_t & g, std::string fn, int cell, int wall) {
+	bmp_maze_t bm;
+	if (!bmp_maze_begin(bm, fn, g.w, g.h, cell, wall)) return false;
+
+	long long words = (g.w + 63) / 64;
+	uint64_t * east = new uint64_t[words];
+	for (int y = 0; y < g.h; y++) {
+		grid_row(g, g.east, y, east);
+		bmp_maze_row(bm, bm.north, east);
+		grid_row(g, g.south, y, bm.north);
+	}
+	bmp_maze_end(bm);
+	delete[] east;
+	return true;
+}
+
+void grid_sink(long long y, int rw, const uint64_t * east, const uint64_t * south, void * user) {
+	grid_t * g = (grid_t *) user;
+	for (int x = 0; x < rw; x++) {
+		long long i = grid_idx(*g, x, (int) y);
+		if (get_bit(east, x)) set_bit(g->east, i);
+		if (get_bit(south, x)) set_bit(g->south, i);
+		set_bit(g->visited, i);
+	}
+}
+
+long long algo_dfs(grid_t & g, rng_t & rng, gen_stats_t * stats, maze_scratch_t * scratch) {
+	if (scratch != NULL)
+		return generate_maze(g, scratch->stk, rng_range(rng, g.w), rng_range(rng, g.h), rng, stats);
+	dir_stack_t stk;
+	dstk_init(stk);
+	long long cycle = generate_maze(g, stk, rng_range(rng, g.w), rng_range(rng, g.h), rng, stats);
+	dstk_free(stk);
+	return cycle;
+}
+
+long long algo_kruskal(grid_t & g, rng_t & rng, gen_stats_t * stats, maze_scratch_t * scratch) {
+	long long cells = (long long) g.w * g.h;
+	long long * walls = scratch_array<long long>(scratch, 2 * cells);
+	long long n_walls = 0;
+	for (int y = 0; y < g.h; y++) {
+		for (int x = 0; x < g.w; x++) {
+			long long i = (long long) y * g.w + x;
+			if (x + 1 < g.w) walls[n_walls++] = i * 2;
+			if (y + 1 < g.h) walls[n_walls++] = i * 2 + 1;
+		}
+	}
+	for (long long i = n_walls - 1; i > 0; i--) {
+		long long j = rng_range(rng, i + 1);
+		std::swap(walls[i], walls[j]);
+	}
+
+	// union find with path halving and union by size
+	long long * parent = scratch_array<long long>(scratch, cells);
+	int * size = scratch_array<int>(scratch, cells);
+	for (long long i = 0; i < cells; i++) {
+		parent[i] = i;
+		size[i] = 1;
+	}
+
+	long long joined = 0;
+	long long k = 0;
+	for (; k < n_walls && joined < cells - 1; k++) {
+		long long a = walls[k] >> 1;
+		long long b = (walls[k] & 1) ? a + g.w : a + 1;
+		while (parent[a] != a) a = parent[a] = parent[parent[a]];
+		while (parent[b] != b) b = parent[b] = parent[parent[b]];
+		if (a == b) continue;
+
+		if (size[a] < size[b]) std::swap(a, b);
+		parent[b] = a;
+		size[a] += size[b];
+
+		long long c = walls[k] >> 1;
+		carve(g, c % g.w, c / g.w, (walls[k] & 1) ? DIR_S : DIR_E);
+		joined++;
+	}
+	memset(g.visited, 0xFF, g.words * sizeof(uint64_t));
+
+	if (stats != NULL) stats->steps += k;
+
+	scratch_release(scratch, walls);
+	scratch_release(scratch, parent);
+	scratch_release(scratch, size);
+	return k;
+}
+
+long long algo_prim(grid_t & g, rng_t & rng, gen_stats_t * stats, maze_scratch_t * scratch) {
+	long long cells = (long long) g.w * g.h;
+	long long * frontier = scratch_array<long long>(scratch, cells); // cells as y * w + x
+	long long n_frontier = 0;
+	uint64_t * queued = scratch_array<uint64_t>(scratch, (cells + 63) / 64);
+	memset(queued, 0, ((cells + 63) / 64) * sizeof(uint64_t));
+
+	long long start = rng_range(rng, cells);
+	grid_set_visited(g, start % g.w, start / g.w);
+	set_bit(queued, start);
+	frontier[n_frontier++] = start;
+
+	long long cycle = 0;
+	long long max_frontier = 1;
+	while (n_frontier > 0) {
+		cycle++;
+
+		long long k = rng_range(rng, n_frontier);
+		long long i = frontier[k];
+		frontier[k] = frontier[--n_frontier];
+		int x = i % g.w;
+		int y = i / g.w;
+
+		if (!grid_visited(g, x, y)) {
+			carve(g, x, y, pick_dir(neighbor_mask(g, x, y, true), rng));
+			grid_set_visited(g, x, y);
+		}
+
+		int m = neighbor_mask(g, x, y, false);
+		for (int d = 0; d < 4; d++) {
+			if (!(m & (1 << d))) continue;
+			int nx = x;
+			int ny = y;
+			step(nx, ny, d);
+			long long j = (long long) ny * g.w + nx;
+			if (get_bit(queued, j)) continue;
+			set_bit(queued, j);
+			frontier[n_frontier++] = j;
+		}
+		max_frontier = std::max(max_frontier, n_frontier);
+	}
+
+	if (stats != NULL) {
+		stats->steps += cycle;
+		stats->max_depth = std::max(stats->max_depth, max_frontier);
+	}
+
+	scratch_release(scratch, frontier);
+	scratch_release(scratch, queued);
+	return cycle;
+}
+
+long long algo_wilson(grid_t & g, rng_t & rng, gen_stats_t * stats, maze_scratch_t * scratch) {
+	long long cells = (long long) g.w * g.h;
+	unsigned char * dirs = scratch_array<unsigned char>(scratch, cells); // by y * w + x
+
+	long long root = rng_range(rng, cells);
+	grid_set_visited(g, root % g.w, root / g.w);
+
+	long long cycle = 0;
+	for (long long i = 0; i < cells; i++) {
+		if (grid_visited(g, i % g.w, i / g.w)) continue;
+
+		// walk until we hit the maze
+		int x = i % g.w;
+		int y = i / g.w;
+		while (!grid_visited(g, x, y)) {
+			cycle++;
+			int m = 0;
+			if (x + 1 < g.w) m |= 1 << DIR_E;
+			if (x > 0) m |= 1 << DIR_W;
+			if (y + 1 < g.h) m |= 1 << DIR_S;
+			if (y > 0) m |= 1 << DIR_N;
+			int d = pick_dir(m, rng);
+			dirs[(long long) y * g.w + x] = d;
+			step(x, y, d);
+		}
+
+		// retrace and carve
+		x = i % g.w;
+		y = i / g.w;
+		while (!grid_visited(g, x, y)) {
+			int d = dirs[(long long) y * g.w + x];
+			grid_set_visited(g, x, y);
+			carve(g, x, y, d);
+			step(x, y, d);
+		}
+	}
+
+	if (stats != NULL) stats->steps += cycle;
+
+	scratch_release(scratch, dirs);
+	return cycle;
+}
+
+long long algo_eller(grid_t & g, rng_t & rng, gen_stats_t * stats, maze_scratch_t * scratch) {
+	generate_maze_stream(g.w, g.h, grid_sink, &g, rng, scratch);
+	if (stats != NULL) stats->steps += g.h;
+	return g.h;
+}
+
+const maze_algo_t maze_algos[] = {
+	{"dfs", algo_dfs},
+	{"kruskal", algo_kruskal},
+	{"prim", algo_prim},
+	{"wilson", algo_wilson},
+	{"eller", algo_eller},
+};
+
+const int n_maze_algos = sizeof(maze_algos) / sizeof(maze_algos[0]);
+
+const maze_algo_t * find_algo(const char * name) {
+	for (int i = 0; i < n_maze_algos; i++) {
+		if (strcmp(maze_algos[i].name, name) == 0) return &maze_algos[i];
+	}
+	return NULL;
+}
+
+double dead_end_ratio(const grid_t & g) {
+	long long dead = 0;
+	for (int y = 0; y < g.h; y++) {
+		for (int x = 0; x < g.w; x++) {
+			int k = open_east(g, x, y) + open_west(g, x, y) + open_south(g, x, y) + open_north(g, x, y);
+			if (k == 1) dead++;
+		}
+	}
+	return (double) dead / ((double) g.w * g.h);
+}
+
+MazeGenerator::MazeGenerator(int w, int h, uint64_t seed, arena_t * arena)
+	: w_(w), h_(h), layout_(LAYOUT_ROWS), algo_(&maze_algos[0]) {
+	rng_seed(rng_, seed);
+	arena_init(own_);
+	arena_ = (arena != NULL) ? arena : &own_;
+	scratch_init(scratch_, *arena_);
+	grid_setup(grid_, 0, 0, LAYOUT_ROWS);
+	grid_.east = grid_.south = grid_.visited = NULL;
+	stats_clear(stats_);
+}
+
+MazeGenerator::~MazeGenerator() {
+	scratch_free(scratch_);
+	arena_free(own_);
+}
+
+bool MazeGenerator::set_algo(const char * name) {
+	const maze_algo_t * a = find_algo(name);
+	if (a == NULL) return false;
+	algo_ = a;
+	return true;
+}
+
+void MazeGenerator::set_layout(int layout) {
+	layout_ = layout;
+}
+
+void MazeGenerator::set_size(int w, int h) {
+	w_ = w;
+	h_ = h;
+}
+
+void MazeGenerator::set_seed(uint64_t seed) {
+	rng_seed(rng_, seed);
+}
+
+void MazeGenerator::reserve() {
+	grid_t g;
+	grid_setup(g, w_, h_, layout_);
+	arena_reserve(*arena_, 3 * ((g.words * sizeof(uint64_t) + 63) & ~(size_t) 63));
+}
+
+const grid_t & MazeGenerator::generate() {
+	scratch_reset(scratch_);
+	grid_init_arena(grid_, w_, h_, layout_, *arena_);
+	stats_clear(stats_);
+	uint64_t draws = rng_.draws;
+	algo_->fn(grid_, rng_, &stats_, &scratch_);
+	stats_.rng_draws = rng_.draws - draws;
+	return grid_;
+}
+
+bool save_maze(const grid_t & g, const char * fn, uint64_t seed, const char * algo) {
+	maze_file_header_t hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, MAZE_FILE_MAGIC, 8);
+	hdr.width = g.w;
+	hdr.height = g.h;
+	hdr.seed = seed;
+	strncpy(hdr.algo, algo, sizeof(hdr.algo) - 1);
+	hdr.words = g.words;
+	hdr.layout = g.layout;
+
+	FILE * f = fopen(fn, "wb");
+	if (f == NULL) return false;
+	bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1
+		&& fwrite(g.east, sizeof(uint64_t), g.words, f) == (size_t) g.words
+		&& fwrite(g.south, sizeof(uint64_t), g.words, f) == (size_t) g.words;
+	return fclose(f) == 0 && ok;
+}
+
+bool load_maze(maze_map_t & m, const char * fn) {
+	m.base = NULL;
+	int fd = open(fn, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(maze_file_header_t)) {
+		close(fd);
+		return false;
+	}
+	m.len = st.st_size;
+	m.base = mmap(NULL, m.len, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd); // the mapping keeps the file open
+	if (m.base == MAP_FAILED) {
+		m.base = NULL;
+		return false;
+	}
+
+	m.hdr = (const maze_file_header_t *) m.base;
+	bool ok = memcmp(m.hdr->magic, MAZE_FILE_MAGIC, 8) == 0 && m.hdr->layout <= LAYOUT_MORTON
+		&& m.hdr->width >= 1 && m.hdr->width <= INT32_MAX
+		&& m.hdr->height >= 1 && m.hdr->height <= INT32_MAX
+		&& memchr(m.hdr->algo, 0, sizeof(m.hdr->algo)) != NULL;
+	if (ok) grid_setup(m.grid, m.hdr->width, m.hdr->height, m.hdr->layout);
+	uint64_t words = ok ? m.grid.words : 0;
+	if (!ok || m.hdr->words != words
+			|| m.len < sizeof(maze_file_header_t) + 2 * words * sizeof(uint64_t)) {
+		munmap(m.base, m.len);
+		m.base = NULL;
+		return false;
+	}
+
+	uint64_t * planes = (uint64_t *) ((char *) m.base + sizeof(maze_file_header_t));
+	m.grid.east = planes;
+	m.grid.south = planes + words;
+	m.grid.visited = NULL;
+	return true;
+}
+
+void unload_maze(maze_map_t & m) {
+	if (m.base != NULL) munmap(m.base, m.len);
+	m.base = NULL;
+}
+
+// shared state for a batch run
+struct batch_job_t {
+	int w;
+	int h;
+	long long count;
+	uint64_t seed;
+	const maze_algo_t * algo;
+	int format;
+	FILE * out; // NULL to throw the mazes away
+	bool lanes; // dfs MAZE_LANES at a time with generate_maze_lanes
+	std::atomic<long long> next;
+};
+
+// batch worker for --lanes. claims MAZE_LANES consecutive mazes at a time
+// and carves them together. the board comes from an arena that is reset
+// per group, so this loop doesn't allocate either
+static void batch_lanes_worker(batch_job_t * job) {
+	grid_t g[MAZE_LANES];
+	for (int l = 0; l < MAZE_LANES; l++)
+		grid_init(g[l], job->w, job->h);
+	arena_t arena;
+	arena_init(arena);
+	maze_scratch_t scratch;
+	scratch_init(scratch, arena);
+	uint64_t * rows = new uint64_t[4 * ((job->w + 63) / 64)];
+	size_t maze_bytes = 64 + render_size(job->w, job->h, job->format);
+	out_buf_t ob;
+	ob_init(ob, job->out, std::max((size_t) 1 << 20, 2 * maze_bytes));
+
+	for (long long i = job->next.fetch_add(MAZE_LANES); i < job->count;
+			i = job->next.fetch_add(MAZE_LANES)) {
+		int n = (int) std::min((long long) MAZE_LANES, job->count - i);
+		uint64_t seeds[MAZE_LANES];
+		for (int l = 0; l < n; l++) {
+			seeds[l] = mix_seed(job->seed) ^ (uint64_t) (i + l);
+			grid_clear(g[l]);
+		}
+		scratch_reset(scratch);
+		generate_maze_lanes(g, n, seeds, &scratch);
+
+		if (job->out == NULL) continue;
+		for (int l = 0; l < n; l++) {
+			if (ob.len + maze_bytes > ob.cap) ob_flush(ob);
+			char * p = ob_reserve(ob, 64);
+			ob.len += snprintf(p, 64, "maze %lld seed %llu\n", i + l, (unsigned long long) seeds[l]);
+			render_grid(ob, g[l], rows, job->format);
+		}
+	}
+
+	if (job->out != NULL) ob_flush(ob);
+	delete[] ob.buf;
+	delete[] rows;
+	scratch_free(scratch);
+	arena_free(arena);
+	for (int l = 0; l < MAZE_LANES; l++)
+		grid_free(g[l]);
+}
+
+// batch worker. the grid planes, render rows and output buffer are
+// allocated once per thread up front, and the backends' stacks and arrays
+// come from a per thread arena reset between mazes, so once the arena has
+// grown the loop doesn't allocate with any backend. maze i is always
+// seeded from (seed, i) no matter which thread makes it. output is
+// buffered per thread and only flushed between mazes, so mazes from
+// different threads never interleave; each starts with its index and seed.
+static void batch_worker(batch_job_t * job) {
+	if (job->lanes) {
+		batch_lanes_worker(job);
+		return;
+	}
+	grid_t g;
+	grid_init(g, job->w, job->h);
+	arena_t arena;
+	arena_init(arena);
+	maze_scratch_t scratch;
+	scratch_init(scratch, arena);
+	uint64_t * rows = new uint64_t[4 * ((job->w + 63) / 64)];
+	size_t maze_bytes = 64 + render_size(job->w, job->h, job->format);
+	out_buf_t ob;
+	ob_init(ob, job->out, std::max((size_t) 1 << 20, 2 * maze_bytes));
+
+	for (long long i = job->next++; i < job->count; i = job->next++) {
+		uint64_t maze_seed = mix_seed(job->seed) ^ (uint64_t) i;
+		rng_t rng;
+		rng_seed(rng, maze_seed);
+		grid_clear(g);
+		scratch_reset(scratch);
+		job->algo->fn(g, rng, NULL, &scratch);
+
+		if (job->out == NULL) continue;
+		if (ob.len + maze_bytes > ob.cap) ob_flush(ob);
+		char * p = ob_reserve(ob, 64);
+		ob.len += snprintf(p, 64, "maze %lld seed %llu\n", i, (unsigned long long) maze_seed);
+		render_grid(ob, g, rows, job->format);
+	}
+
+	if (job->out != NULL) ob_flush(ob);
+	delete[] ob.buf;
+	delete[] rows;
+	scratch_free(scratch);
+	arena_free(arena);
+	grid_free(g);
+}
+
+void run_batch(int bw, int bh, long long count, int n_threads, uint64_t seed,
+		const maze_algo_t * algo, int format, FILE * out, bool lanes) {
+	batch_job_t job;
+	job.w = bw;
+	job.h = bh;
+	job.count = count;
+	job.seed = seed;
+	job.algo = algo;
+	job.format = format;
+	job.out = out;
+	job.lanes = lanes;
+	job.next = 0;
+
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (int i = 0; i < n_threads; i++)
+		workers.push_back(std::thread(batch_worker, &job));
+	for (int i = 0; i < n_threads; i++)
+		workers[i].join();
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	if (out != NULL) fflush(out);
+
+	double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+	std::cerr << "batch: " << count << " mazes " << bw << "x" << bh << " algo: "
+		<< (lanes ? "dfs lanes" : algo->name) << " threads: " << n_threads << " ms: " << ms
+		<< " mazes/s: " << count / ms * 1e3 << std::endl;
+}
+
+static inline uint64_t chunk_key(int cx, int cy) {
+	return ((uint64_t) (uint32_t) cx << 32) | (uint32_t) cy;
+}
+
+bool world_init(world_t & wd, uint64_t seed, int chunk, int capacity) {
+	if (chunk < 1 || capacity < 1) return false;
+
+	wd.seed = seed;
+	wd.chunk = chunk;
+	wd.capacity = capacity;
+	wd.used = 0;
+	wd.slots = new chunk_t[capacity];
+	for (int i = 0; i < capacity; i++)
+		grid_init(wd.slots[i].g, chunk, chunk);
+	wd.head = wd.tail = -1;
+	wd.index.reserve(capacity);
+	dstk_init(wd.stk);
+	wd.hits = wd.misses = 0;
+	return true;
+}
+
+void world_free(world_t & wd) {
+	for (int i = 0; i < wd.capacity; i++)
+		grid_free(wd.slots[i].g);
+	delete[] wd.slots;
+	wd.index.clear();
+	dstk_free(wd.stk);
+}
+
+static void lru_unlink(world_t & wd, int i) {
+	chunk_t & c = wd.slots[i];
+	if (c.prev >= 0) wd.slots[c.prev].next = c.next; else wd.head = c.next;
+	if (c.next >= 0) wd.slots[c.next].prev = c.prev; else wd.tail = c.prev;
+}
+
+static void lru_push_front(world_t & wd, int i) {
+	chunk_t & c = wd.slots[i];
+	c.prev = -1;
+	c.next = wd.head;
+	if (wd.head >= 0) wd.slots[wd.head].prev = i;
+	wd.head = i;
+	if (wd.tail < 0) wd.tail = i;
+}
+
+const grid_t & world_chunk(world_t & wd, int cx, int cy) {
+	uint64_t key = chunk_key(cx, cy);
+	std::unordered_map<uint64_t, int>::iterator it = wd.index.find(key);
+	if (it != wd.index.end()) {
+		wd.hits++;
+		if (wd.head != it->second) {
+			lru_unlink(wd, it->second);
+			lru_push_front(wd, it->second);
+		}
+		return wd.slots[it->second].g;
+	}
+
+	wd.misses++;
+	int i;
+	if (wd.used < wd.capacity) {
+		i = wd.used++;
+	} else {
+		i = wd.tail;
+		lru_unlink(wd, i);
+		wd.index.erase(chunk_key(wd.slots[i].cx, wd.slots[i].cy));
+	}
+
+	chunk_t & c = wd.slots[i];
+	c.cx = cx;
+	c.cy = cy;
+	grid_clear(c.g);
+	rng_t rng;
+	rng_seed(rng, mix_seed(wd.seed) ^ key);
+	generate_maze(c.g, wd.stk, rng_range(rng, wd.chunk), rng_range(rng, wd.chunk), rng);
+
+	lru_push_front(wd, i);
+	wd.index[key] = i;
+	return c.g;
+}
+
+// row (for an east edge) or column (south edge) of the door out of chunk
+// (cx, cy) in direction d
+static inline int chunk_door(const world_t & wd, int cx, int cy, int d) {
+	uint64_t h = mix_seed(mix_seed(wd.seed ^ 0xD00AULL) ^ chunk_key(cx, cy) ^ ((uint64_t) d << 62));
+	return (int) (((unsigned __int128) h * wd.chunk) >> 64);
+}
+
+// floor division so negative coordinates land in the right chunk
+static inline long long floor_div(long long a, long long b) {
+	return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+bool world_open_east(world_t & wd, long long x, long long y) {
+	int cx = (int) floor_div(x, wd.chunk);
+	int cy = (int) floor_div(y, wd.chunk);
+	int lx = (int) (x - (long long) cx * wd.chunk);
+	int ly = (int) (y - (long long) cy * wd.chunk);
+	if (lx == wd.chunk - 1) return ly == chunk_door(wd, cx, cy, DIR_E);
+	return open_east(world_chunk(wd, cx, cy), lx, ly);
+}
+
+bool world_open_south(world_t & wd, long long x, long long y) {
+	int cx = (int) floor_div(x, wd.chunk);
+	int cy = (int) floor_div(y, wd.chunk);
+	int lx = (int) (x - (long long) cx * wd.chunk);
+	int ly = (int) (y - (long long) cy * wd.chunk);
+	if (ly == wd.chunk - 1) return lx == chunk_door(wd, cx, cy, DIR_S);
+	return open_south(world_chunk(wd, cx, cy), lx, ly);
+}
+
+bool world_open_west(world_t & wd, long long x, long long y) {
+	return world_open_east(wd, x - 1, y);
+}
+
+bool world_open_north(world_t & wd, long long x, long long y) {
+	return world_open_south(wd, x, y - 1);
+}
+
+void world_window(world_t & wd, long long x0, long long y0, grid_t & g) {
+	grid_clear(g);
+	for (int y = 0; y < g.h; y++) {
+		for (int x = 0; x < g.w; x++) {
+			long long i = grid_idx(g, x, y);
+			set_bit(g.visited, i);
+			if (world_open_east(wd, x0 + x, y0 + y)) set_bit(g.east, i);
+			if (world_open_south(wd, x0 + x, y0 + y)) set_bit(g.south, i);
+		}
+	}
+}
+
+const char * layout_names[3] = {"rows", "tiled", "morton"};
+
+const char * solve_names[3] = {"bfs", "astar", "bidi"};
+
+void solver_init(solver_t & s, long long cells) {
+	s.cells = cells;
+	s.queue = new uint32_t[cells];
+	s.seen = new uint64_t[2 * ((cells + 63) / 64)];
+	s.from = new uint8_t[(cells + 3) / 4];
+}
+
+void solver_free(solver_t & s) {
+	delete[] s.queue;
+	delete[] s.seen;
+	delete[] s.from;
+	s.queue = NULL;
+	s.seen = NULL;
+	s.from = NULL;
+}
+
+static inline void set_from(uint8_t * from, long long i, int d) {
+	int sh = (i & 3) * 2;
+	from[i >> 2] = (from[i >> 2] & ~(3 << sh)) | (d << sh);
+}
+
+static inline int get_from(const uint8_t * from, long long i) {
+	return (from[i >> 2] >> ((i & 3) * 2)) & 3;
+}
+
+// steps from (x, y) back to the root of its search tree
+static inline long long chain_length(const solver_t & s, const grid_t & g, int x, int y, long long root) {
+	long long n = 0;
+	while ((long long) y * g.w + x != root) {
+		step(x, y, get_from(s.from, (long long) y * g.w + x) ^ 1);
+		n++;
+	}
+	return n;
+}
+
+// fill res.path with the chain from the start to (ax, ay), then from
+// (bx, by) to the goal. in plain bfs and a* (bx, by) is the goal itself
+static void build_path(const solver_t & s, const grid_t & g, int ax, int ay, long long start,
+		int bx, int by, long long goal, solve_result_t & res) {
+	long long na = chain_length(s, g, ax, ay, start);
+	long long nb = (bx < 0) ? -1 : chain_length(s, g, bx, by, goal);
+	res.length = na + nb + 1;
+	res.path.resize(res.length + 1);
+
+	point_t p = {ax, ay};
+	for (long long k = na; k >= 0; k--) {
+		res.path[k] = p;
+		if (k > 0) step(p.x, p.y, get_from(s.from, (long long) p.y * g.w + p.x) ^ 1);
+	}
+	if (bx < 0) return;
+	p.x = bx;
+	p.y = by;
+	for (long long k = na + 1; k <= res.length; k++) {
+		res.path[k] = p;
+		if (k < res.length) step(p.x, p.y, get_from(s.from, (long long) p.y * g.w + p.x) ^ 1);
+	}
+}
+
+bool solve_maze(solver_t & s, const grid_t & g, int sx, int sy, int tx, int ty, int algo,
+		solve_result_t & res) {
+	long long cells = (long long) g.w * g.h;
+	res.length = -1;
+	res.expanded = 0;
+	res.path.clear();
+	if (cells > s.cells || cells > 0xFFFFFFFFLL) return false;
+
+	long long words = (cells + 63) / 64;
+	uint64_t * seen_a = s.seen;
+	uint64_t * seen_b = s.seen + words;
+	uint32_t * q = s.queue;
+	long long start = (long long) sy * g.w + sx;
+	long long goal = (long long) ty * g.w + tx;
+	const int dx[4] = {1, -1, 0, 0};
+	const int dy[4] = {0, 0, 1, -1};
+	const long long di[4] = {1, -1, g.w, -g.w};
+
+	memset(seen_a, 0, words * sizeof(uint64_t));
+	set_bit(seen_a, start);
+
+	if (algo == SOLVE_BFS) {
+		long long head = 0;
+		long long tail = 0;
+		q[tail++] = start;
+		while (head < tail) {
+			long long i = q[head++];
+			res.expanded++;
+			if (i == goal) {
+				build_path(s, g, tx, ty, start, -1, -1, goal, res);
+				return true;
+			}
+			int x = i % g.w;
+			int y = i / g.w;
+			int m = open_mask(g, x, y);
+			for (int d = 0; d < 4; d++) {
+				if (!(m >> d & 1) || get_bit(seen_a, i + di[d])) continue;
+				set_bit(seen_a, i + di[d]);
+				set_from(s.from, i + di[d], d);
+				q[tail++] = i + di[d];
+			}
+		}
+		return false;
+	}
+
+	if (algo == SOLVE_ASTAR) {
+		// ring buffer deque, head is the front, count entries after it
+		long long head = 0;
+		long long count = 1;
+		q[0] = start;
+		while (count > 0) {
+			long long i = q[head];
+			head = (head + 1 == cells) ? 0 : head + 1;
+			count--;
+			res.expanded++;
+			if (i == goal) {
+				build_path(s, g, tx, ty, start, -1, -1, goal, res);
+				return true;
+			}
+			int x = i % g.w;
+			int y = i / g.w;
+			int m = open_mask(g, x, y);
+			for (int d = 0; d < 4; d++) {
+				if (!(m >> d & 1) || get_bit(seen_a, i + di[d])) continue;
+				set_bit(seen_a, i + di[d]);
+				set_from(s.from, i + di[d], d);
+				int nx = x + dx[d];
+				int ny = y + dy[d];
+				if (abs(tx - nx) + abs(ty - ny) < abs(tx - x) + abs(ty - y)) {
+					head = (head == 0) ? cells - 1 : head - 1;
+					q[head] = i + di[d];
+				} else {
+					long long tail = head + count;
+					q[(tail >= cells) ? tail - cells : tail] = i + di[d];
+				}
+				count++;
+			}
+		}
+		return false;
+	}
+
+	// SOLVE_BIDI
+	memset(seen_b, 0, words * sizeof(uint64_t));
+	set_bit(seen_b, goal);
+	if (start == goal) {
+		res.expanded = 1;
+		build_path(s, g, sx, sy, start, -1, -1, goal, res);
+		return true;
+	}
+	// side a uses q[a_head, a_tail), side b uses q[b_tail, b_head) growing down
+	long long a_head = 0;
+	long long a_tail = 0;
+	long long b_head = cells;
+	long long b_tail = cells;
+	q[a_tail++] = start;
+	q[--b_tail] = goal;
+	while (a_head < a_tail && b_tail < b_head) {
+		bool side_a = (a_tail - a_head) <= (b_head - b_tail);
+		uint64_t * mine = side_a ? seen_a : seen_b;
+		uint64_t * other = side_a ? seen_b : seen_a;
+		long long level = side_a ? a_tail - a_head : b_head - b_tail;
+		for (long long k = 0; k < level; k++) {
+			long long i = side_a ? q[a_head++] : q[--b_head];
+			res.expanded++;
+			int x = i % g.w;
+			int y = i / g.w;
+			int m = open_mask(g, x, y);
+			for (int d = 0; d < 4; d++) {
+				long long n = i + di[d];
+				if (!(m >> d & 1) || get_bit(mine, n)) continue;
+				if (get_bit(other, n)) {
+					// the two trees touch across the passage i - n
+					if (side_a) {
+						build_path(s, g, x, y, start, x + dx[d], y + dy[d], goal, res);
+					} else {
+						build_path(s, g, x + dx[d], y + dy[d], start, x, y, goal, res);
+					}
+					return true;
+				}
+				set_bit(mine, n);
+				set_from(s.from, n, d);
+				if (side_a) {
+					q[a_tail++] = n;
+				} else {
+					q[--b_tail] = n;
+				}
+			}
+		}
+	}
+	return false;
+}
+
+long long bfs_distance(const grid_t & g, int sx, int sy, int tx, int ty) {
+	solver_t s;
+	solver_init(s, (long long) g.w * g.h);
+	solve_result_t res;
+	solve_maze(s, g, sx, sy, tx, ty, SOLVE_BFS, res);
+	solver_free(s);
+	return res.length;
+}
+
+bool dist_index_build(dist_index_t & di, const grid_t & g, int rx, int ry) {
+	long long cells = (long long) g.w * g.h;
+	di.w = g.w;
+	di.h = g.h;
+	di.first = NULL;
+	di.depth = NULL;
+	di.sparse = NULL;
+	di.from = NULL;
+	if (cells >= 0x80000000LL) return false;
+
+	di.first = new uint32_t[cells];
+	di.depth = new uint32_t[2 * cells];
+	di.from = new uint8_t[(cells + 3) / 4];
+	memset(di.first, 0xFF, cells * sizeof(uint32_t));
+
+	const int dx[4] = {1, -1, 0, 0};
+	const int dy[4] = {0, 0, 1, -1};
+	long long root = (long long) ry * g.w + rx;
+	long long cur = root;
+	int x = rx;
+	int y = ry;
+	uint32_t d = 0;
+	int next = 0;
+	long long n = 0;
+	di.first[cur] = n;
+	di.depth[n++] = d;
+	while (true) {
+		int m = open_mask(g, x, y);
+		for (; next < 4; next++) {
+			if (!(m >> next & 1)) continue;
+			long long c = cur + dx[next] + (long long) dy[next] * g.w;
+			if (di.first[c] != NO_TOUR) continue;
+			break;
+		}
+		if (next < 4) {
+			// down to an unvisited neighbor
+			cur += dx[next] + (long long) dy[next] * g.w;
+			x += dx[next];
+			y += dy[next];
+			set_from(di.from, cur, next);
+			di.first[cur] = n;
+			di.depth[n++] = ++d;
+			next = 0;
+			continue;
+		}
+		if (cur == root) break;
+		// back up to the parent, then try the directions after this one
+		int pd = get_from(di.from, cur);
+		x -= dx[pd];
+		y -= dy[pd];
+		cur -= dx[pd] + (long long) dy[pd] * g.w;
+		di.depth[n++] = --d;
+		next = pd + 1;
+	}
+	di.tour = n;
+
+	di.blocks = (n + DIST_BLOCK - 1) / DIST_BLOCK;
+	di.levels = 64 - __builtin_clzll(di.blocks);
+	di.sparse = new uint32_t[di.levels * di.blocks];
+	for (long long b = 0; b < di.blocks; b++) {
+		long long end = std::min(n, (b + 1) * DIST_BLOCK);
+		uint32_t lo = di.depth[b * DIST_BLOCK];
+		for (long long i = b * DIST_BLOCK + 1; i < end; i++) lo = std::min(lo, di.depth[i]);
+		di.sparse[b] = lo;
+	}
+	for (int k = 1; k < di.levels; k++) {
+		uint32_t * prev = di.sparse + (k - 1) * di.blocks;
+		uint32_t * row = di.sparse + k * di.blocks;
+		long long half = 1LL << (k - 1);
+		for (long long b = 0; b + 2 * half <= di.blocks; b++)
+			row[b] = std::min(prev[b], prev[b + half]);
+	}
+	return true;
+}
+
+void dist_index_free(dist_index_t & di) {
+	delete[] di.first;
+	delete[] di.depth;
+	delete[] di.sparse;
+	delete[] di.from;
+	di.first = di.depth = di.sparse = NULL;
+	di.from = NULL;
+}
+
+// maze_distance for n queries, q[4 * i .. 4 * i + 3] = ax, ay, bx, by, into
+// out. a query is a chain of cache misses (first, then the tour, then the
+// sparse table), so one at a time they run end to end. here the first
+// visits are prefetched 2 * DIST_AHEAD queries ahead and the tour and table
+// reads DIST_AHEAD ahead, so the misses of different queries overlap
+const int DIST_AHEAD = 8;
+
+void maze_distances(const dist_index_t & di, const int * q, long long n, long long * out) {
+	for (long long i = 0; i < n; i++) {
+		if (i + 2 * DIST_AHEAD < n) {
+			const int * p = q + 4 * (i + 2 * DIST_AHEAD);
+			__builtin_prefetch(di.first + (long long) p[1] * di.w + p[0]);
+			__builtin_prefetch(di.first + (long long) p[3] * di.w + p[2]);
+		}
+		if (i + DIST_AHEAD < n) {
+			const int * p = q + 4 * (i + DIST_AHEAD);
+			long long l = di.first[(long long) p[1] * di.w + p[0]];
+			long long r = di.first[(long long) p[3] * di.w + p[2]];
+			if (l != NO_TOUR && r != NO_TOUR) {
+				if (l > r) std::swap(l, r);
+				__builtin_prefetch(di.depth + l);
+				__builtin_prefetch(di.depth + r);
+				long long bl = l / DIST_BLOCK;
+				long long br = r / DIST_BLOCK;
+				__builtin_prefetch(di.depth + br * DIST_BLOCK);
+				if (bl + 1 < br) {
+					int k = 63 - __builtin_clzll(br - bl - 1);
+					__builtin_prefetch(di.sparse + k * di.blocks + bl + 1);
+					__builtin_prefetch(di.sparse + k * di.blocks + br - (1LL << k));
+				}
+			}
+		}
+		out[i] = maze_distance(di, q[4 * i], q[4 * i + 1], q[4 * i + 2], q[4 * i + 3]);
+	}
+}
+
+long long maze_path(const dist_index_t & di, int ax, int ay, int bx, int by, std::vector<point_t> & path) {
+	path.clear();
+	long long dist = maze_distance(di, ax, ay, bx, by);
+	if (dist < 0) return -1;
+	long long up_a = di.depth[di.first[(long long) ay * di.w + ax]]
+		- (long long) di.depth[di.first[(long long) by * di.w + bx]];
+	up_a = (dist + up_a) / 2; // steps from a up to the lca
+	path.resize(dist + 1);
+
+	point_t p = {ax, ay};
+	for (long long k = 0; k <= up_a; k++) {
+		path[k] = p;
+		if (k < up_a) step(p.x, p.y, get_from(di.from, (long long) p.y * di.w + p.x) ^ 1);
+	}
+	p.x = bx;
+	p.y = by;
+	for (long long k = dist; k > up_a; k--) {
+		path[k] = p;
+		step(p.x, p.y, get_from(di.from, (long long) p.y * di.w + p.x) ^ 1);
+	}
+	return dist;
+}
+
+// follow the corridor out of (x, y) by d until a node, the cell stop or
+// (x, y) again (a ring with no junction). leaves the end in x, y and the
+// last step in d, and returns the steps taken. every cell entered, the end
+// included, is appended to out if it isn't NULL
+static long long corridor_walk(const junction_graph_t & jg, const grid_t & g, int & x, int & y, int & d,
+		long long stop, std::vector<point_t> * out) {
+	long long origin = (long long) y * g.w + x;
+	long long n = 0;
+	while (true) {
+		step(x, y, d);
+		n++;
+		if (out != NULL) {
+			point_t p = {x, y};
+			out->push_back(p);
+		}
+		long long c = (long long) y * g.w + x;
+		if (c == stop || c == origin || junction_is_node(jg, c)) return n;
+		d = __builtin_ctz(open_mask(g, x, y) & ~(1 << (d ^ 1)));
+	}
+}
+
+bool junction_build(junction_graph_t & jg, const grid_t & g) {
+	long long cells = (long long) g.w * g.h;
+	long long words = (cells + 63) / 64;
+	jg.w = g.w;
+	jg.h = g.h;
+	jg.nodes = 0;
+	jg.edges = 0;
+	jg.is_node = NULL;
+	jg.rank = NULL;
+	jg.cell = NULL;
+	jg.offset = NULL;
+	jg.edge = NULL;
+	jg.dir = NULL;
+	if (cells > 0xFFFFFFFFLL) return false;
+
+	jg.is_node = new uint64_t[words]();
+	jg.rank = new uint32_t[words];
+	long long c = 0;
+	for (int y = 0; y < g.h; y++) {
+		for (int x = 0; x < g.w; x++, c++) {
+			int m = open_mask(g, x, y);
+			if (__builtin_popcount(m) != 2) {
+				set_bit(jg.is_node, c);
+				jg.edges += __builtin_popcount(m);
+			}
+		}
+	}
+	for (long long i = 0; i < words; i++) {
+		jg.rank[i] = jg.nodes;
+		jg.nodes += __builtin_popcountll(jg.is_node[i]);
+	}
+
+	jg.cell = new uint32_t[jg.nodes];
+	jg.offset = new uint32_t[jg.nodes + 1];
+	jg.edge = new junction_edge_t[jg.edges];
+	jg.dir = new uint8_t[jg.edges];
+	long long n = 0;
+	long long e = 0;
+	for (long long i = 0; i < words; i++) {
+		for (uint64_t bits = jg.is_node[i]; bits != 0; bits &= bits - 1) {
+			long long nc = i * 64 + __builtin_ctzll(bits);
+			jg.cell[n] = nc;
+			jg.offset[n++] = e;
+			int m = open_mask(g, nc % g.w, nc / g.w);
+			for (int d = 0; d < 4; d++) {
+				if (!(m >> d & 1)) continue;
+				int x = nc % g.w;
+				int y = nc / g.w;
+				int wd = d;
+				jg.edge[e].weight = corridor_walk(jg, g, x, y, wd, -1, NULL);
+				jg.edge[e].to = junction_node(jg, (long long) y * g.w + x);
+				jg.dir[e++] = d;
+			}
+		}
+	}
+	jg.offset[n] = e;
+	return true;
+}
+
+void junction_free(junction_graph_t & jg) {
+	delete[] jg.is_node;
+	delete[] jg.rank;
+	delete[] jg.cell;
+	delete[] jg.offset;
+	delete[] jg.edge;
+	delete[] jg.dir;
+	jg.is_node = NULL;
+	jg.rank = jg.cell = jg.offset = NULL;
+	jg.edge = NULL;
+	jg.dir = NULL;
+}
+
+void junction_search_init(junction_search_t & js, const junction_graph_t & jg) {
+	js.nodes = jg.nodes;
+	js.query = 0;
+	js.visit = new junction_visit_t[jg.nodes]();
+	js.heap.reserve(1024);
+}
+
+void junction_search_free(junction_search_t & js) {
+	delete[] js.visit;
+	js.visit = NULL;
+}
+
+// a cell's way onto the graph: itself if it's a node, else the nodes at
+// both ends of its corridor
+struct junction_end_t {
+	int k;          // ends found, 0 .. 2
+	uint32_t node[2];
+	uint32_t len[2];
+	int dir[2];     // dir_t out of the cell toward node[i]
+	long long hit;  // steps to the stop cell if a walk passed it, else -1
+	int hit_dir;
+};
+
+static void junction_ends(const junction_graph_t & jg, const grid_t & g, int x, int y, long long stop,
+		junction_end_t & je) {
+	long long c = (long long) y * g.w + x;
+	je.k = 0;
+	je.node[0] = je.node[1] = NO_VIA;
+	je.hit = -1;
+	if (junction_is_node(jg, c)) {
+		je.node[0] = junction_node(jg, c);
+		je.len[0] = 0;
+		je.dir[0] = -1;
+		je.k = 1;
+		return;
+	}
+	int m = open_mask(g, x, y);
+	for (int d = 0; d < 4; d++) {
+		if (!(m >> d & 1)) continue;
+		int ex = x;
+		int ey = y;
+		int ed = d;
+		long long n = corridor_walk(jg, g, ex, ey, ed, stop, NULL);
+		if ((long long) ey * g.w + ex == stop && !junction_is_node(jg, stop)) {
+			if (je.hit < 0 || n < je.hit) {
+				je.hit = n;
+				je.hit_dir = d;
+			}
+			// carry on past the stop cell to the node behind it
+			ed = __builtin_ctz(open_mask(g, ex, ey) & ~(1 << (ed ^ 1)));
+			n += corridor_walk(jg, g, ex, ey, ed, c, NULL);
+		}
+		long long ec = (long long) ey * g.w + ex;
+		if (!junction_is_node(jg, ec)) continue; // back at (x, y), a ring with no nodes
+		je.node[je.k] = junction_node(jg, ec);
+		je.len[je.k] = n;
+		je.dir[je.k++] = d;
+	}
+}
+
+bool junction_solve(junction_search_t & js, const junction_graph_t & jg, const grid_t & g,
+		int sx, int sy, int tx, int ty, solve_result_t & res) {
+	long long start = (long long) sy * g.w + sx;
+	long long goal = (long long) ty * g.w + tx;
+	res.length = -1;
+	res.expanded = 0;
+	res.path.clear();
+	point_t sp = {sx, sy};
+	res.path.push_back(sp);
+	if (start == goal) {
+		res.length = 0;
+		return true;
+	}
+
+	junction_end_t se;
+	junction_end_t ge;
+	junction_ends(jg, g, sx, sy, goal, se);
+	junction_ends(jg, g, tx, ty, -1, ge);
+	long long best = (se.hit >= 0) ? se.hit : LLONG_MAX;
+	int best_end = -1; // -1 for the direct walk
+
+	if (++js.query == 0) {
+		// the stamps wrapped, start them over
+		for (long long i = 0; i < js.nodes; i++) js.visit[i].stamp = 0;
+		js.query = 1;
+	}
+	js.heap.clear();
+	for (int i = 0; i < se.k; i++) {
+		uint32_t u = se.node[i];
+		junction_visit_t & vu = js.visit[u];
+		if (vu.stamp == js.query && vu.dist <= se.len[i]) continue;
+		vu.stamp = js.query;
+		vu.dist = se.len[i];
+		vu.via = NO_VIA;
+		vu.seed = se.dir[i];
+		uint64_t key = vu.dist + abs((int) (jg.cell[u] % g.w) - tx) + abs((int) (jg.cell[u] / g.w) - ty);
+		js.heap.push_back(key << 32 | u);
+		std::push_heap(js.heap.begin(), js.heap.end(), std::greater<uint64_t>());
+	}
+
+	while (!js.heap.empty()) {
+		uint64_t top = js.heap.front();
+		std::pop_heap(js.heap.begin(), js.heap.end(), std::greater<uint64_t>());
+		js.heap.pop_back();
+		long long key = top >> 32;
+		uint32_t u = top & 0xFFFFFFFF;
+		if (key >= best) break;
+		int ux = jg.cell[u] % g.w;
+		int uy = jg.cell[u] / g.w;
+		uint32_t du = js.visit[u].dist;
+		if (key != du + abs(ux - tx) + abs(uy - ty)) continue; // stale entry
+		res.expanded++;
+
+		for (int j = 0; j < ge.k; j++) {
+			if (ge.node[j] == u && du + ge.len[j] < best) {
+				best = du + ge.len[j];
+				best_end = j;
+			}
+		}
+		for (uint32_t e = jg.offset[u]; e < jg.offset[u + 1]; e++) {
+			uint32_t v = jg.edge[e].to;
+			uint32_t nd = du + jg.edge[e].weight;
+			junction_visit_t & vv = js.visit[v];
+			if (vv.stamp == js.query && vv.dist <= nd) continue;
+			vv.stamp = js.query;
+			vv.dist = nd;
+			vv.via = e;
+			if (jg.offset[v + 1] - jg.offset[v] == 1 && v != ge.node[0] && v != ge.node[1]) {
+				// a dead end that isn't the goal's leads nowhere
+				continue;
+			}
+			uint64_t vkey = nd + abs((int) (jg.cell[v] % g.w) - tx) + abs((int) (jg.cell[v] / g.w) - ty);
+			js.heap.push_back(vkey << 32 | v);
+			std::push_heap(js.heap.begin(), js.heap.end(), std::greater<uint64_t>());
+		}
+	}
+	if (best == LLONG_MAX) return false;
+	res.length = best;
+
+	int x = sx;
+	int y = sy;
+	if (best_end < 0) {
+		int d = se.hit_dir;
+		corridor_walk(jg, g, x, y, d, goal, &res.path);
+		return true;
+	}
+
+	// edges back from the goal's end node to the start's, then forward
+	js.chain.clear();
+	uint32_t u = ge.node[best_end];
+	while (js.visit[u].via != NO_VIA) {
+		uint32_t e = js.visit[u].via;
+		js.chain.push_back(e);
+		u = std::upper_bound(jg.offset, jg.offset + jg.nodes + 1, e) - jg.offset - 1;
+	}
+	if (js.visit[u].seed != NO_VIA) {
+		int d = js.visit[u].seed;
+		corridor_walk(jg, g, x, y, d, -1, &res.path);
+	}
+	for (long long k = (long long) js.chain.size() - 1; k >= 0; k--) {
+		uint32_t e = js.chain[k];
+		int d = jg.dir[e];
+		corridor_walk(jg, g, x, y, d, -1, &res.path);
+	}
+
+	// the goal's corridor was walked from the goal, so add it reversed
+	if (ge.dir[best_end] >= 0) {
+		js.tail.clear();
+		int gx = tx;
+		int gy = ty;
+		int d = ge.dir[best_end];
+		corridor_walk(jg, g, gx, gy, d, -1, &js.tail);
+		for (long long k = (long long) js.tail.size() - 2; k >= 0; k--) res.path.push_back(js.tail[k]);
+		point_t tp = {tx, ty};
+		res.path.push_back(tp);
+	}
+	return true;
+}
+
+const char * hw_names[HW_N] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+
+void hw_open(hw_counters_t & hc) {
+	const uint64_t config[HW_N] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+	for (int i = 0; i < HW_N; i++) {
+		struct perf_event_attr pe;
+		memset(&pe, 0, sizeof(pe));
+		pe.type = PERF_TYPE_HARDWARE;
+		pe.size = sizeof(pe);
+		pe.config = config[i];
+		pe.disabled = 1;
+		pe.inherit = 1;
+		pe.exclude_kernel = 1;
+		pe.exclude_hv = 1;
+		hc.fd[i] = syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+		hc.val[i] = -1;
+	}
+}
+
+void hw_start(hw_counters_t & hc) {
+	for (int i = 0; i < HW_N; i++) {
+		if (hc.fd[i] < 0) continue;
+		ioctl(hc.fd[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(hc.fd[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+void hw_stop(hw_counters_t & hc) {
+	for (int i = 0; i < HW_N; i++) {
+		if (hc.fd[i] < 0) continue;
+		ioctl(hc.fd[i], PERF_EVENT_IOC_DISABLE, 0);
+		long long v;
+		if (read(hc.fd[i], &v, sizeof(v)) == sizeof(v)) hc.val[i] = v;
+	}
+}
+
+void hw_close(hw_counters_t & hc) {
+	for (int i = 0; i < HW_N; i++) {
+		if (hc.fd[i] >= 0) close(hc.fd[i]);
+		hc.fd[i] = -1;
+	}
+}
+
+void write_stats_json(FILE * f, int sw, int sh, const char * algo, uint64_t seed, int threads,
+		const gen_stats_t & st, double init_ms, double gen_ms, double render_ms,
+		const hw_counters_t * hw) {
+	fprintf(f, "{\"w\":%d,\"h\":%d,\"algo\":\"%s\",\"seed\":%llu,\"threads\":%d,"
+		"\"steps\":%lld,\"backtracks\":%lld,\"max_depth\":%lld,\"rng_draws\":%lld,"
+		"\"init_ms\":%.3f,\"generate_ms\":%.3f,\"render_ms\":%.3f,\"ns_per_cell\":%.3f",
+		sw, sh, algo, (unsigned long long) seed, threads,
+		st.steps, st.backtracks, st.max_depth, st.rng_draws,
+		init_ms, gen_ms, render_ms, gen_ms * 1e6 / ((double) sw * sh));
+	if (hw != NULL) {
+		for (int i = 0; i < HW_N; i++) {
+			if (hw->val[i] < 0) {
+				fprintf(f, ",\"%s\":null", hw_names[i]);
+			} else {
+				fprintf(f, ",\"%s\":%lld", hw_names[i], hw->val[i]);
+			}
+		}
+	}
+	fprintf(f, "}\n");
+	fflush(f);
+}
@@ -0,0 +1,927 @@
+#ifndef MAZE_H
+#define MAZE_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <unordered_map>
+#include <algorithm>
+#include "bitmap.h"
+
+// unpacked view of a single cell. n/s/e/w are true when the passage in that
+// direction is open
+struct tile_t {
+	bool visited;
+
+	bool n;
+	bool s;
+	bool e;
+	bool w;
+	
+	bool solid;
+};
+
+struct point_t {
+	int x;
+	int y;
+};
+
+// cell orders a grid_t can use for its planes. LAYOUT_ROWS is plain
+// y * w + x: cheap to index but a north/south step in a wide maze lands a
+// whole row away. LAYOUT_TILED packs each 8 x 8 block of cells into one
+// word (blocks in row order), so all four neighbors are usually in the same
+// or an adjacent word. LAYOUT_MORTON orders cells on a z-order curve inside
+// square power of two blocks of up to 1024 x 1024 (blocks in row order).
+enum layout_t { LAYOUT_ROWS = 0, LAYOUT_TILED = 1, LAYOUT_MORTON = 2 };
+
+// bit packed maze grid. a perfect maze only needs to know if the passage
+// east and south of each cell is open, west and north are read from the
+// neighbor. each plane holds one bit per cell (at grid_idx(x, y)) packed
+// into 64 bit words, so a cell costs 3 bits instead of sizeof(tile_t) bytes.
+struct grid_t {
+	int w;
+	int h;
+	long long words; // words per plane
+	int layout;
+	int shift;        // log2 of the morton block side
+	long long stride; // blocks per row for the tiled and morton layouts
+
+	uint64_t * east;    // passage to (x + 1, y) is open
+	uint64_t * south;   // passage to (x, y + 1) is open
+	uint64_t * visited; // only meaningful while generating
+};
+
+inline bool get_bit(const uint64_t * p, long long i) {
+	return (p[i >> 6] >> (i & 63)) & 1;
+}
+
+inline void set_bit(uint64_t * p, long long i) {
+	p[i >> 6] |= (uint64_t) 1 << (i & 63);
+}
+
+// read n <= 64 bits starting at bit i
+inline uint64_t get_bits(const uint64_t * p, long long i, int n) {
+	int off = i & 63;
+	uint64_t v = p[i >> 6] >> off;
+	if (off + n > 64) v |= p[(i >> 6) + 1] << (64 - off);
+	return (n == 64) ? v : v & (((uint64_t) 1 << n) - 1);
+}
+
+// bump allocator for memory that is used for a while and then dropped all
+// at once. allocations are cut from one block, 64 byte aligned; one that
+// doesn't fit gets a block of its own, and the next arena_reset swaps all
+// of them for a single block as big as everything handed out since the
+// last reset. a job that resets and asks for the same memory again stops
+// allocating after its first run. only for types that need no destructor.
+struct arena_t {
+	char * base;
+	size_t cap;
+	size_t used;
+	size_t peak;               // bytes handed out since the last reset
+	std::vector<char *> extra; // blocks for allocations that didn't fit
+};
+
+void arena_init(arena_t & a, size_t cap = 0);
+void arena_free(arena_t & a);
+
+// size bytes, not cleared
+void * arena_alloc(arena_t & a, size_t size);
+
+// give everything back at once, see above
+void arena_reset(arena_t & a);
+
+// grow an empty arena's block to at least size bytes up front
+void arena_reserve(arena_t & a, size_t size);
+
+template <class T> T * arena_array(arena_t & a, size_t n) {
+	return (T *) arena_alloc(a, n * sizeof(T));
+}
+
+// fill in the size and layout fields of g without allocating anything
+void grid_setup(grid_t & g, int gw, int gh, int layout);
+
+void grid_init(grid_t & g, int gw, int gh, int layout = LAYOUT_ROWS);
+
+// grid_init with cleared planes out of a. they go away with the next
+// arena_reset, don't grid_free them
+void grid_init_arena(grid_t & g, int gw, int gh, int layout, arena_t & a);
+
+void grid_free(grid_t & g);
+
+// wipe all planes so the grid can be generated into again
+void grid_clear(grid_t & g);
+
+// spread the low 16 bits of v out to the even bits
+inline uint32_t part1by1(uint32_t v) {
+	v &= 0xFFFF;
+	v = (v | (v << 8)) & 0x00FF00FF;
+	v = (v | (v << 4)) & 0x0F0F0F0F;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+inline long long grid_idx(const grid_t & g, int x, int y) {
+	switch (g.layout) {
+	case LAYOUT_TILED:
+		return (((y >> 3) * g.stride + (x >> 3)) << 6) | ((y & 7) << 3) | (x & 7);
+	case LAYOUT_MORTON: {
+		int m = (1 << g.shift) - 1;
+		long long block = (long long) (y >> g.shift) * g.stride + (x >> g.shift);
+		return (block << (2 * g.shift)) | part1by1(x & m) | (part1by1(y & m) << 1);
+	}
+	default:
+		return (long long) y * g.w + x;
+	}
+}
+
+inline bool grid_visited(const grid_t & g, int x, int y) {
+	return get_bit(g.visited, grid_idx(g, x, y));
+}
+
+inline void grid_set_visited(grid_t & g, int x, int y) {
+	set_bit(g.visited, grid_idx(g, x, y));
+}
+
+// passage queries. out of bounds is always a wall
+inline bool open_east(const grid_t & g, int x, int y) {
+	return get_bit(g.east, grid_idx(g, x, y));
+}
+
+inline bool open_south(const grid_t & g, int x, int y) {
+	return get_bit(g.south, grid_idx(g, x, y));
+}
+
+inline bool open_west(const grid_t & g, int x, int y) {
+	return x > 0 && open_east(g, x - 1, y);
+}
+
+inline bool open_north(const grid_t & g, int x, int y) {
+	return y > 0 && open_south(g, x, y - 1);
+}
+
+// directions used by the generator. d ^ 1 is the opposite direction
+enum dir_t { DIR_E = 0, DIR_W = 1, DIR_S = 2, DIR_N = 3 };
+
+// knock down the wall between (x, y) and its neighbor in direction d
+inline void carve(grid_t & g, int x, int y, int d) {
+	switch (d) {
+	case DIR_E: set_bit(g.east, grid_idx(g, x, y)); break;
+	case DIR_W: set_bit(g.east, grid_idx(g, x - 1, y)); break;
+	case DIR_S: set_bit(g.south, grid_idx(g, x, y)); break;
+	case DIR_N: set_bit(g.south, grid_idx(g, x, y - 1)); break;
+	}
+}
+
+tile_t get_tile(const grid_t & g, int x, int y);
+
+// output buffer written out with one fwrite per cap bytes
+struct out_buf_t {
+	FILE * f;
+	char * buf;
+	size_t cap;
+	size_t len;
+};
+
+void ob_init(out_buf_t & ob, FILE * f, size_t cap);
+
+void ob_flush(out_buf_t & ob);
+
+void ob_free(out_buf_t & ob);
+
+// make room for n more bytes and return where to write them
+inline char * ob_reserve(out_buf_t & ob, size_t n) {
+	if (ob.len + n > ob.cap) {
+		ob_flush(ob);
+		if (n > ob.cap) {
+			delete[] ob.buf;
+			ob.buf = new char[n];
+			ob.cap = n;
+		}
+	}
+	return ob.buf + ob.len;
+}
+
+inline void ob_puts(out_buf_t & ob, const char * str) {
+	size_t n = strlen(str);
+	memcpy(ob_reserve(ob, n), str, n);
+	ob.len += n;
+}
+
+// RENDER_ABC is the A/B/C three lines per row format of print_maze.
+// RENDER_COMPACT is one character per cell, the hex digit of its open
+// directions as a dir_t bit mask (1 east, 2 west, 4 south, 8 north).
+enum render_t { RENDER_ABC = 0, RENDER_COMPACT = 1 };
+
+// render one row of cells. north is the south plane of the row above and
+// visited may be NULL for a finished maze. all rows are word aligned bitsets
+void render_row(out_buf_t & ob, int rw, const uint64_t * north, const uint64_t * east,
+		const uint64_t * south, const uint64_t * visited, int format);
+
+// copy row y of a grid plane into a word aligned row bitset
+void grid_row(const grid_t & g, const uint64_t * plane, int y, uint64_t * row);
+
+// render all rows of g into ob. rows is scratch space for 4 row bitsets of
+// (g.w + 63) / 64 words each, so callers rendering many mazes can reuse it
+void render_grid(out_buf_t & ob, const grid_t & g, uint64_t * rows, int format);
+
+// bytes render_grid writes for a w x h maze
+size_t render_size(int rw, int rh, int format);
+
+// write the whole maze to f through one large buffer
+void render_maze(const grid_t & g, FILE * f, int format);
+
+void print_maze(const grid_t & g, int format = RENDER_ABC);
+
+void print_visited(const grid_t & g);
+
+// splitmix64 finalizer, turns (seed, stream index) into an unrelated seed
+inline uint64_t mix_seed(uint64_t x) {
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+// xoshiro256** generator. 32 bytes of state, fast, and the same seed gives
+// the same sequence everywhere, unlike rand(). each thread or stream keeps
+// its own rng_t.
+struct rng_t {
+	uint64_t s[4];
+	uint64_t draws; // numbers handed out so far, for stats
+};
+
+inline uint64_t rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+void rng_seed(rng_t & r, uint64_t seed);
+
+inline uint64_t rng_next(rng_t & r) {
+	uint64_t result = rotl(r.s[1] * 5, 7) * 9;
+	uint64_t t = r.s[1] << 17;
+	r.s[2] ^= r.s[0];
+	r.s[3] ^= r.s[1];
+	r.s[1] ^= r.s[2];
+	r.s[0] ^= r.s[3];
+	r.s[2] ^= t;
+	r.s[3] = rotl(r.s[3], 45);
+	r.draws++;
+	return result;
+}
+
+// random number in [0, n) from a single draw (multiply high, no division)
+inline uint64_t rng_range(rng_t & r, uint64_t n) {
+	return (uint64_t) (((unsigned __int128) rng_next(r) * n) >> 64);
+}
+
+// move (x, y) one step in direction d
+inline void step(int & x, int & y, int d) {
+	switch (d) {
+	case DIR_E: x++; break;
+	case DIR_W: x--; break;
+	case DIR_S: y++; break;
+	case DIR_N: y--; break;
+	}
+}
+
+// unvisited (or visited, if want is true) neighbors of (x, y) as a 4 bit
+// mask indexed by dir_t
+inline int neighbor_mask(const grid_t & g, int x, int y, bool want) {
+	int m = 0;
+	m |= (x + 1 < g.w && grid_visited(g, x + 1, y) == want) << DIR_E;
+	m |= (x > 0 && grid_visited(g, x - 1, y) == want) << DIR_W;
+	m |= (y + 1 < g.h && grid_visited(g, x, y + 1) == want) << DIR_S;
+	m |= (y > 0 && grid_visited(g, x, y - 1) == want) << DIR_N;
+	return m;
+}
+
+// select_dir[m][k] is the k-th set bit of the 4 bit mask m
+const unsigned char select_dir[16][4] = {
+	{0, 0, 0, 0}, {0, 0, 0, 0}, {1, 0, 0, 0}, {0, 1, 0, 0},
+	{2, 0, 0, 0}, {0, 2, 0, 0}, {1, 2, 0, 0}, {0, 1, 2, 0},
+	{3, 0, 0, 0}, {0, 3, 0, 0}, {1, 3, 0, 0}, {0, 1, 3, 0},
+	{2, 3, 0, 0}, {0, 2, 3, 0}, {1, 2, 3, 0}, {0, 1, 2, 3}
+};
+
+// pick a random set bit of a non zero 4 bit mask with one draw
+inline int pick_dir(int m, rng_t & rng) {
+	return select_dir[m][rng_range(rng, __builtin_popcount(m))];
+}
+
+// backtrack stack for the dfs. instead of coordinates each entry is the
+// 2 bit direction that was taken to reach the cell, packed 32 to a word, so
+// the position is rebuilt by stepping back while unwinding. the words live
+// in fixed size chunks allocated as the stack grows and kept for reuse.
+struct dir_stack_t {
+	std::vector<uint64_t *> chunks;
+	long long size;
+	arena_t * arena; // where chunks come from, NULL for the heap
+};
+
+const long long DIR_CHUNK_WORDS = 4096;
+
+const long long DIR_CHUNK = DIR_CHUNK_WORDS * 32; // entries per chunk
+
+void dstk_init(dir_stack_t & st, arena_t * arena = NULL);
+
+void dstk_free(dir_stack_t & st);
+
+inline void dstk_push(dir_stack_t & st, int d) {
+	long long c = st.size / DIR_CHUNK;
+	if (c == (long long) st.chunks.size())
+		st.chunks.push_back((st.arena != NULL) ? arena_array<uint64_t>(*st.arena, DIR_CHUNK_WORDS)
+			: new uint64_t[DIR_CHUNK_WORDS]);
+	long long i = st.size % DIR_CHUNK;
+	uint64_t & word = st.chunks[c][i >> 5];
+	int shift = (i & 31) * 2;
+	word = (word & ~((uint64_t) 3 << shift)) | ((uint64_t) d << shift);
+	st.size++;
+}
+
+inline int dstk_pop(dir_stack_t & st) {
+	st.size--;
+	long long i = st.size % DIR_CHUNK;
+	return (st.chunks[st.size / DIR_CHUNK][i >> 5] >> ((i & 31) * 2)) & 3;
+}
+
+// counters a generator adds to when it is handed a gen_stats_t. backends
+// leave the fields they have no notion of alone. rng draws are read off
+// rng_t.draws by whoever owns the generator.
+struct gen_stats_t {
+	long long steps;      // main loop cycles
+	long long backtracks; // dfs pops
+	long long max_depth;  // deepest dfs stack, biggest prim frontier
+	long long rng_draws;
+};
+
+void stats_clear(gen_stats_t & st);
+
+// memory the backends can reuse from one maze to the next: per call arrays
+// come out of arena, and the dfs stack keeps its chunk table while taking
+// its chunks from the arena. whoever owns it calls scratch_reset between
+// mazes. a backend handed NULL uses the heap instead.
+struct maze_scratch_t {
+	arena_t * arena;
+	dir_stack_t stk;
+};
+
+void scratch_init(maze_scratch_t & sc, arena_t & arena);
+void scratch_free(maze_scratch_t & sc);
+
+// forget the stack chunks, then arena_reset
+void scratch_reset(maze_scratch_t & sc);
+
+// n Ts for one call, out of the scratch arena or off the heap
+template <class T> T * scratch_array(maze_scratch_t * sc, size_t n) {
+	return (sc != NULL) ? arena_array<T>(*sc->arena, n) : new T[n];
+}
+
+// give back a scratch_array. arena memory stays until scratch_reset
+template <class T> void scratch_release(maze_scratch_t * sc, T * p) {
+	if (sc == NULL) delete[] p;
+}
+
+// carve a perfect maze into g with an iterative recursive backtracker
+// starting at (sx, sy). every cell is pushed and popped at most once and the
+// number of unvisited cells is tracked as we go, so this is linear in w * h.
+// stk should be empty, it grows as needed. returns the number of cycles run.
+long long generate_maze(grid_t & g, dir_stack_t & stk, int sx, int sy, rng_t & rng,
+		gen_stats_t * stats = NULL);
+
+// small mazes carved MAZE_LANES at a time, one per SIMD lane, with AVX2
+// gathers where the cpu has them. each lane is a recursive backtracker like
+// generate_maze, but the backtrack stack is a parent direction kept in every
+// cell, so all lanes run the same branch free step in lockstep and a lane
+// that finishes early just idles. lane l carves grids[l] from seeds[l] with
+// its own xoshiro128** stream, so it is a different maze from algo_dfs with
+// the same seed.
+const int MAZE_LANES = 16;
+const int LANE_MAX_SIDE = 16;
+
+// carve 1 to MAZE_LANES cleared grids, all the same size, at most
+// LANE_MAX_SIDE a side. the board the lanes share comes from scratch if it
+// isn't NULL. returns the number of lockstep cycles run, or -1 without
+// touching the grids if any of that doesn't hold
+long long generate_maze_lanes(grid_t * grids, int n, const uint64_t * seeds,
+		maze_scratch_t * scratch = NULL);
+
+// generate a maze on n_threads threads. the grid is cut into tile x tile
+// squares, each carved into its own perfect maze in parallel. the tiles are
+// then treated as cells of a small maze: carving that gives a spanning tree
+// over the tiles, and for each tile edge in it exactly one random wall on
+// the shared seam is opened. a tree of trees joined by tiles - 1 edges is
+// still a single spanning tree over all cells. returns false, leaving g
+// alone, unless tile and n_threads are at least 1
+bool generate_maze_parallel(grid_t & g, int tile, int n_threads, uint64_t seed,
+		gen_stats_t * stats = NULL);
+
+// what verify_maze found. a perfect maze has leaks == 0,
+// edges == cells - 1 and reached == cells
+struct verify_result_t {
+	long long cells;
+	long long edges;   // open passages
+	long long leaks;   // passages out of the grid
+	long long reached; // cells connected to (0, 0), 0 if the counts already failed
+};
+
+// check g is a perfect maze: no passages out of the grid, exactly
+// w * h - 1 passages and every cell reachable from (0, 0). a connected
+// graph with cells - 1 edges is a spanning tree. (west and north are read
+// from the neighbor's east and south bit, so wall pairs can't disagree.)
+//
+// passages are counted with popcounts. the flood fill works on 8 x 8
+// blocks of cells held in one word each: a block is flooded to a fixed
+// point with shifts and masks, then whatever crosses its edges is or'd
+// into the four neighbor blocks, which go on a work queue if that added
+// anything. memory is a bit per cell for the reached set, plus two for the
+// regrouped planes unless g is already LAYOUT_TILED, plus a queue entry
+// per block.
+bool verify_maze(const grid_t & g, verify_result_t * res = NULL);
+
+// receives finished rows from the streaming generator. east and south hold
+// the passage bits for row y packed the same way as a grid_t plane, but
+// starting at bit 0 of word 0. rows arrive in order and the buffers are
+// only valid for the duration of the call.
+typedef void (*row_sink_t)(long long y, int rw, const uint64_t * east, const uint64_t * south, void * user);
+
+// generate a rw x rows maze one row at a time with eller's algorithm and
+// hand each finished row to sink. only O(rw) state is kept so rows can be
+// anything up to the range of a long long.
+void generate_maze_stream(int rw, long long rows, row_sink_t sink, void * user, rng_t & rng,
+		maze_scratch_t * scratch = NULL);
+
+// sink state for printing streamed rows in the same formats as print_maze.
+// north needs the previous row's south bits so keep a copy.
+struct ascii_sink_t {
+	long long rows;
+	int format;
+	uint64_t * north;
+	out_buf_t ob;
+};
+
+void ascii_sink(long long y, int rw, const uint64_t * east, const uint64_t * south, void * user);
+
+// maze rasterizer state. cells are cell x cell pixels of floor separated by
+// wall pixel thick walls. every pixel row inside a band of the image is the
+// same, so each band is built once as a scanline out of solid wall / floor
+// spans and written out as many times as it is tall. only one scanline is
+// ever in memory.
+struct bmp_maze_t {
+	bitmap_stream_t bs;
+	int w;
+	long long rows;
+	int cell;
+	int wall;
+	unsigned char * line;
+	unsigned char * wall_px; // max(cell, wall) pixels of wall colour
+	unsigned char * floor_px;
+	uint64_t * north; // previous row's south bits, for the sink
+};
+
+// false when the file can't be opened or the image would be more than
+// INT32_MAX pixels a side
+bool bmp_maze_begin(bmp_maze_t & bm, std::string fn, int mw, long long rows, int cell, int wall);
+
+// one row of cells: the band of walls above it, then the cells themselves
+// with the west walls between them
+void bmp_maze_row(bmp_maze_t & bm, const uint64_t * north, const uint64_t * east);
+
+// bottom border, then close the file
+void bmp_maze_end(bmp_maze_t & bm);
+
+// row sink for the streaming generator, so mazes of any height can be
+// drawn without the grid or the image ever being in memory. it ends the
+// image after the last row; with no rows at all, call bmp_maze_end yourself
+void bmp_sink(long long y, int rw, const uint64_t * east, const uint64_t * south, void * user);
+
+// draw a whole grid to fn
+bool render_bmp(const grid_t & g, std::string fn, int cell, int wall);
+
+// sink that copies streamed rows into a full grid_t, for when it fits in
+// memory and the rest of the tools are wanted
+void grid_sink(long long y, int rw, const uint64_t * east, const uint64_t * south, void * user);
+
+// every backend carves a perfect maze into an empty grid g, marking cells
+// visited as it goes, adds to stats if it isn't NULL and returns the number
+// of steps taken. working memory comes from scratch if it isn't NULL
+typedef long long (*maze_algo_fn)(grid_t & g, rng_t & rng, gen_stats_t * stats, maze_scratch_t * scratch);
+
+long long algo_dfs(grid_t & g, rng_t & rng, gen_stats_t * stats, maze_scratch_t * scratch = NULL);
+
+// randomized kruskal: shuffle every interior wall and knock it down if the
+// cells on either side are not connected yet. wall ids are cell * 2 for the
+// east wall and cell * 2 + 1 for the south wall, cells numbered y * w + x
+// whatever the grid layout.
+long long algo_kruskal(grid_t & g, rng_t & rng, gen_stats_t * stats, maze_scratch_t * scratch = NULL);
+
+// randomized prim: grow the maze from one cell by repeatedly taking a random
+// frontier cell and joining it to a random neighbor already in the maze
+long long algo_prim(grid_t & g, rng_t & rng, gen_stats_t * stats, maze_scratch_t * scratch = NULL);
+
+// wilson: loop erased random walks. from each cell not in the maze walk at
+// random, remembering only the last direction left each cell, until the walk
+// hits the maze, then carve the loop free path the directions describe.
+// unbiased (uniform spanning tree) but slow at the start.
+long long algo_wilson(grid_t & g, rng_t & rng, gen_stats_t * stats, maze_scratch_t * scratch = NULL);
+
+// eller: the streaming generator writing into the grid
+long long algo_eller(grid_t & g, rng_t & rng, gen_stats_t * stats, maze_scratch_t * scratch = NULL);
+
+struct maze_algo_t {
+	const char * name;
+	maze_algo_fn fn;
+};
+
+extern const maze_algo_t maze_algos[];
+
+extern const int n_maze_algos;
+
+// look up a backend by name, NULL if there is none
+const maze_algo_t * find_algo(const char * name);
+
+// fraction of cells with a single opening. a rough texture measure: dfs
+// gives long corridors and few dead ends, prim and kruskal lots of short ones
+double dead_end_ratio(const grid_t & g);
+
+// generates mazes one after another for a caller that embeds the library.
+// the grid, the dfs stack and the backends' working memory all come out of
+// one arena (the caller's, or one of its own) that is reset at the start
+// of each generate(), so once it has made the biggest maze it will be asked
+// for, generating allocates nothing. the grid returned stays valid until
+// the next generate() or the generator goes away. a fresh generator, or one
+// just given set_seed(n), makes the same maze as mazetest --seed n.
+class MazeGenerator {
+public:
+	MazeGenerator(int w, int h, uint64_t seed, arena_t * arena = NULL);
+	~MazeGenerator();
+
+	// backend by name, see maze_algos. false if there is none
+	bool set_algo(const char * name);
+	void set_layout(int layout);
+	void set_size(int w, int h);
+	void set_seed(uint64_t seed);
+
+	// size the arena for the grid now rather than on the first generate()
+	void reserve();
+
+	// carve the next maze, continuing the rng stream
+	const grid_t & generate();
+
+	const grid_t & grid() const { return grid_; }
+	const gen_stats_t & stats() const { return stats_; } // of the last maze
+	const maze_algo_t * algo() const { return algo_; }
+
+private:
+	MazeGenerator(const MazeGenerator &);
+	MazeGenerator & operator=(const MazeGenerator &);
+
+	int w_;
+	int h_;
+	int layout_;
+	const maze_algo_t * algo_;
+	rng_t rng_;
+	arena_t own_;
+	arena_t * arena_;
+	maze_scratch_t scratch_;
+	grid_t grid_;
+	gen_stats_t stats_;
+};
+
+// binary maze file. a 64 byte header followed by the east plane and then
+// the south plane, each exactly as grid_t holds it in memory (header.words
+// little endian uint64_t words). the planes start 8 byte aligned so a
+// loader can mmap the file and point a grid_t straight at them.
+struct maze_file_header_t {
+	char magic[8];   // "MAZEBIN1"
+	uint32_t width;
+	uint32_t height;
+	uint64_t seed;
+	char algo[16];   // backend name, nul padded
+	uint64_t words;  // words per plane
+	uint32_t layout; // layout_t of the planes, 0 (rows) in older files
+	uint32_t reserved0;
+	uint64_t reserved;
+};
+
+const char MAZE_FILE_MAGIC[8] = {'M', 'A', 'Z', 'E', 'B', 'I', 'N', '1'};
+
+bool save_maze(const grid_t & g, const char * fn, uint64_t seed, const char * algo);
+
+// a maze file mapped into memory. grid points into the mapping: the wall
+// queries (open_east etc.) work on it directly, nothing is parsed or copied
+// and pages are only read in as they are touched. it is read only and has
+// no visited plane, so don't generate into it.
+struct maze_map_t {
+	void * base;
+	size_t len;
+	const maze_file_header_t * hdr;
+	grid_t grid;
+};
+
+// false unless fn has the magic, a known layout, 1 to INT32_MAX cells a
+// side, a nul terminated algo and all the words that size needs
+bool load_maze(maze_map_t & m, const char * fn);
+
+void unload_maze(maze_map_t & m);
+
+// generate count w x h mazes on n_threads threads and report mazes/s. with
+// lanes they are carved with generate_maze_lanes instead of algo
+void run_batch(int bw, int bh, long long count, int n_threads, uint64_t seed,
+		const maze_algo_t * algo, int format, FILE * out, bool lanes = false);
+
+// an unbounded maze world made of chunk x chunk tiles, generated only when
+// touched. chunk (cx, cy) is always carved from the same rng seed, derived
+// from the world seed and its coordinates, so evicting and regenerating a
+// chunk gives back the same cells. inside a chunk the maze is perfect; the
+// door in each chunk edge is a pure function of the world seed and the
+// edge, so both chunks agree on it without either being loaded, and every
+// chunk opens onto all four neighbors. (that makes loops at chunk scale:
+// an infinite world has no locally decidable spanning tree that keeps
+// neighbors close.) chunks live in a fixed number of slots recycled in
+// lru order, so memory does not grow however far a client wanders.
+struct chunk_t {
+	int cx;
+	int cy;
+	grid_t g;
+	int prev; // lru list, head is most recently used
+	int next;
+};
+
+struct world_t {
+	uint64_t seed;
+	int chunk;
+	int capacity;
+	int used;
+	chunk_t * slots;
+	int head;
+	int tail;
+	std::unordered_map<uint64_t, int> index; // chunk key -> slot
+	dir_stack_t stk;
+	long long hits;
+	long long misses;
+};
+
+// capacity chunks of chunk x chunk cells. returns false, with nothing to
+// free, unless both are at least 1
+bool world_init(world_t & wd, uint64_t seed, int chunk, int capacity);
+
+void world_free(world_t & wd);
+
+// the cells of chunk (cx, cy), generated into the least recently used slot
+// on a miss. the reference is good until the next world_chunk call
+const grid_t & world_chunk(world_t & wd, int cx, int cy);
+
+// world wall queries, same meaning as open_east etc. on a grid_t
+bool world_open_east(world_t & wd, long long x, long long y);
+
+bool world_open_south(world_t & wd, long long x, long long y);
+
+bool world_open_west(world_t & wd, long long x, long long y);
+
+bool world_open_north(world_t & wd, long long x, long long y);
+
+// copy the window of the world with top left corner (x0, y0) into g, e.g.
+// to print or draw it. passages out of the window are kept
+void world_window(world_t & wd, long long x0, long long y0, grid_t & g);
+
+inline double ms_between(std::chrono::steady_clock::time_point t0, std::chrono::steady_clock::time_point t1) {
+	return std::chrono::duration<double, std::milli>(t1 - t0).count();
+}
+
+extern const char * layout_names[3];
+
+// searches solve_maze can run
+enum solve_algo_t { SOLVE_BFS = 0, SOLVE_ASTAR = 1, SOLVE_BIDI = 2 };
+
+extern const char * solve_names[3];
+
+// scratch space for solve_maze, allocated once for grids of up to cells
+// cells and reused for every solve. cells are y * w + x as uint32_t, which
+// caps a grid at 2^32 - 1 cells but halves the queue
+struct solver_t {
+	long long cells;
+	uint32_t * queue; // frontier(s), cells entries
+	uint64_t * seen;  // two bitsets of cells bits, one per search side
+	uint8_t * from;   // 2 bit dir_t per cell, the step that reached it
+};
+
+// what solve_maze found
+struct solve_result_t {
+	long long length;          // steps from start to goal, -1 if unreachable
+	long long expanded;        // cells taken off a frontier
+	std::vector<point_t> path; // start to goal, both included
+};
+
+void solver_init(solver_t & s, long long cells);
+
+void solver_free(solver_t & s);
+
+// open passages out of (x, y) as a 4 bit mask indexed by dir_t. passages
+// off the edge (a world_window cut, a bad file) are left out
+inline int open_mask(const grid_t & g, int x, int y) {
+	return ((x + 1 < g.w && open_east(g, x, y)) << DIR_E) | (open_west(g, x, y) << DIR_W)
+		| ((y + 1 < g.h && open_south(g, x, y)) << DIR_S) | (open_north(g, x, y) << DIR_N);
+}
+
+// find the path from (sx, sy) to (tx, ty). every search marks cells when
+// they are queued, keeps a 2 bit back pointer per cell and queues cells as
+// uint32_t in s.queue:
+//   SOLVE_BFS   level order from the start.
+//   SOLVE_ASTAR best first on steps + manhattan distance to the goal. a step
+//               changes that sum by 0 or 2, so the open set is a deque (the
+//               queue used as a ring): same sum to the front, +2 to the back.
+//   SOLVE_BIDI  bfs from both ends, a level of the smaller frontier at a
+//               time, until a cell reached from one end sees the other. the
+//               start side queues from the front of s.queue, the goal side
+//               from the back; a cell is only ever on one side.
+// a perfect maze has exactly one path so all three return it. on grids with
+// loops bfs and bidi still find a shortest path, a* some path.
+// returns false if the goal can't be reached or the grid is too big for s
+bool solve_maze(solver_t & s, const grid_t & g, int sx, int sy, int tx, int ty, int algo,
+		solve_result_t & res);
+
+// length of the path from (sx, sy) to (tx, ty) by plain bfs, -1 if there
+// is none. the bookkeeping is layout independent (cells as y * w + x) so
+// timing it shows what the layout does to wall lookups
+long long bfs_distance(const grid_t & g, int sx, int sy, int tx, int ty);
+
+// distance index for a perfect maze, built once after generation. the maze
+// is a tree, so dist(a, b) = depth(a) + depth(b) - 2 * depth(lca(a, b)),
+// and the lca depth is the smallest depth on the euler tour between the
+// first visits of a and b. the tour depths are split into blocks of
+// DIST_BLOCK with a sparse table over the block minimums: a query scans at
+// most two partial blocks and reads two table entries. about 14 bytes per
+// cell, and tours are indexed with uint32_t so the grid must have under
+// 2^31 cells.
+const int DIST_BLOCK = 32;
+
+const uint32_t NO_TOUR = 0xFFFFFFFF;
+
+struct dist_index_t {
+	int w;
+	int h;
+	long long tour;    // tour length, 2 * reached cells - 1
+	long long blocks;  // tour blocks
+	int levels;        // sparse table levels
+	uint32_t * first;  // tour position of each cell's first visit, NO_TOUR if not reached
+	uint32_t * depth;  // tree depth at each tour position
+	uint32_t * sparse; // sparse[k * blocks + b] = min depth in blocks b .. b + 2^k - 1
+	uint8_t * from;    // 2 bit dir_t per cell, the step from its parent
+};
+
+// walk the tree from (rx, ry) and build the index. the walk needs no stack:
+// going down sets the child's back pointer, coming back up follows it and
+// carries on with the next direction. cells that were already visited are
+// skipped, so on a grid with loops this indexes a spanning tree instead.
+// returns false if the grid is too big
+bool dist_index_build(dist_index_t & di, const grid_t & g, int rx = 0, int ry = 0);
+
+void dist_index_free(dist_index_t & di);
+
+// smallest depth over tour positions [l, r]
+inline uint32_t tour_min(const dist_index_t & di, long long l, long long r) {
+	long long bl = l / DIST_BLOCK;
+	long long br = r / DIST_BLOCK;
+	uint32_t lo = NO_TOUR;
+	if (bl == br) {
+		for (long long i = l; i <= r; i++) lo = std::min(lo, di.depth[i]);
+		return lo;
+	}
+	for (long long i = l; i < (bl + 1) * DIST_BLOCK; i++) lo = std::min(lo, di.depth[i]);
+	for (long long i = br * DIST_BLOCK; i <= r; i++) lo = std::min(lo, di.depth[i]);
+	if (bl + 1 < br) {
+		// two overlapping power of two runs cover blocks bl + 1 .. br - 1
+		long long len = br - bl - 1;
+		int k = 63 - __builtin_clzll(len);
+		const uint32_t * row = di.sparse + k * di.blocks;
+		lo = std::min(lo, std::min(row[bl + 1], row[br - (1LL << k)]));
+	}
+	return lo;
+}
+
+// steps between (ax, ay) and (bx, by), -1 if they aren't connected
+inline long long maze_distance(const dist_index_t & di, int ax, int ay, int bx, int by) {
+	long long l = di.first[(long long) ay * di.w + ax];
+	long long r = di.first[(long long) by * di.w + bx];
+	if (l == NO_TOUR || r == NO_TOUR) return -1;
+	if (l > r) std::swap(l, r);
+	return (long long) di.depth[l] + di.depth[r] - 2LL * tour_min(di, l, r);
+}
+
+void maze_distances(const dist_index_t & di, const int * q, long long n, long long * out);
+
+// the cells from (ax, ay) to (bx, by), both included, into path. both ends
+// climb their back pointers to the lca depth, so this is linear in the
+// length of the path. returns the length, -1 if they aren't connected
+long long maze_path(const dist_index_t & di, int ax, int ay, int bx, int by, std::vector<point_t> & path);
+
+// corridor contracted graph of a maze. most cells have exactly two open
+// sides, so a search spends most of its time walking corridors one cell at
+// a time. here every cell with any other number of openings (junctions,
+// dead ends) is a node and each corridor between two nodes is one
+// weighted edge, stored both ways in csr form: the edges of node n are
+// edge[offset[n]] .. edge[offset[n + 1] - 1]. a node's id is its rank among the node
+// cells in y * w + x order, read from the is_node bitset and a count per
+// word, so the cell to node map costs a bit and a half per cell.
+struct junction_edge_t {
+	uint32_t to;     // node at the far end
+	uint32_t weight; // steps along the corridor
+};
+
+struct junction_graph_t {
+	int w;
+	int h;
+	long long nodes;
+	long long edges;    // csr entries, two per corridor
+	uint64_t * is_node; // bit per cell
+	uint32_t * rank;    // nodes before each word of is_node
+	uint32_t * cell;    // y * w + x of each node
+	uint32_t * offset;  // nodes + 1 entries
+	junction_edge_t * edge;
+	uint8_t * dir;      // dir_t of the first step out of the node, per edge
+};
+
+inline bool junction_is_node(const junction_graph_t & jg, long long c) {
+	return get_bit(jg.is_node, c);
+}
+
+inline uint32_t junction_node(const junction_graph_t & jg, long long c) {
+	uint64_t below = jg.is_node[c >> 6] & (((uint64_t) 1 << (c & 63)) - 1);
+	return jg.rank[c >> 6] + __builtin_popcountll(below);
+}
+
+// find the nodes and walk every corridor out of each one. returns false if
+// the grid has 2^32 cells or more
+bool junction_build(junction_graph_t & jg, const grid_t & g);
+
+void junction_free(junction_graph_t & jg);
+
+const uint32_t NO_VIA = 0xFFFFFFFF;
+
+// search state of one node, together since a relaxation touches all of it.
+// only valid when stamp matches the current query
+struct junction_visit_t {
+	uint32_t stamp;
+	uint32_t dist;
+	uint32_t via;  // csr edge that reached the node, NO_VIA for a start
+	uint32_t seed; // for a start: dir_t from the start cell toward it, NO_VIA if it is the start
+};
+
+// scratch for junction_solve, sized for one graph and reused across
+// queries. the stamps mean nothing is cleared between queries
+struct junction_search_t {
+	long long nodes;
+	uint32_t query;
+	junction_visit_t * visit;
+	std::vector<uint64_t> heap;  // (a* key << 32) | node, min heap
+	std::vector<uint32_t> chain; // edges of the path, goal end first
+	std::vector<point_t> tail;   // the goal's corridor, walked from the goal
+};
+
+void junction_search_init(junction_search_t & js, const junction_graph_t & jg);
+
+void junction_search_free(junction_search_t & js);
+
+// shortest path from (sx, sy) to (tx, ty) over the contracted graph, into
+// res as cells like solve_maze (expanded counts nodes). a* over the nodes,
+// keyed on distance plus manhattan distance to the goal; a corridor is
+// never shorter than the manhattan distance it covers, so keys never drop
+// along a path and the search can stop once the best key reaches the best
+// goal distance so far. the start is seeded with the nodes at the ends of
+// its corridor, the goal is finished from the nodes at the ends of its
+// own, and a start and goal in the same corridor also get the direct walk.
+// returns false if the goal can't be reached
+bool junction_solve(junction_search_t & js, const junction_graph_t & jg, const grid_t & g,
+		int sx, int sy, int tx, int ty, solve_result_t & res);
+
+// optional hardware counters read through perf_event_open, following this
+// thread and any it starts. counters the kernel won't give us (no
+// permission, no pmu in a vm) read as -1.
+enum { HW_CYCLES = 0, HW_INSTRUCTIONS, HW_CACHE_MISSES, HW_BRANCH_MISSES, HW_N };
+
+extern const char * hw_names[HW_N];
+
+struct hw_counters_t {
+	int fd[HW_N];
+	long long val[HW_N];
+};
+
+void hw_open(hw_counters_t & hc);
+
+void hw_start(hw_counters_t & hc);
+
+void hw_stop(hw_counters_t & hc);
+
+void hw_close(hw_counters_t & hc);
+
+// one run as a single json line, appended to f so a file of them can be
+// diffed between builds. hw may be NULL when counters weren't asked for
+void write_stats_json(FILE * f, int sw, int sh, const char * algo, uint64_t seed, int threads,
+		const gen_stats_t & st, double init_ms, double gen_ms, double render_ms,
+		const hw_counters_t * hw);
+
+#endif // MAZE_H
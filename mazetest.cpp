@@ -17,203 +17,694 @@ namespace patch
 #endif // PATCH_H
 
 #include <iostream>
+#include <fstream>
 #include <cstdlib>
+#include <climits>
 #include <stdlib.h>
 #include <time.h>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include "maze.h"
 
-int w = 20;
-int h = 10;
-int stack_size = w * h;
-
-struct tile_t {
-	bool visited;
-
-	bool n;
-	bool s;
-	bool e;
-	bool w;
-	
-	bool solid;
-};
-
-struct point_t {
-	int x;
-	int y;
-};
-
-void set_tile(tile_t & t, bool v, bool N, bool S, bool E, bool W) {
-	t.visited = v;
-	t.n = N;
-	t.s = S;
-	t.e = E;
-	t.w = W;
-	
-	t.solid = false;
-}
-
-void print_maze(tile_t * g) {
-	std::cout << "maze:" << std::endl;
-	for (int y = 0; y < h; y++){
+// old print_maze: builds std::strings through patch::to_string and flushes
+// every line. kept so --bench-render has something to compare against
+void print_maze_ostream(const grid_t & g, std::ostream & os) {
+	os << "maze:" << std::endl;
+	for (int y = 0; y < g.h; y++){
 		std::string ln1;
 		std::string ln2;
 		std::string ln3;
-		for (int x = 0; x < w; x++){
-			ln1 += "O" + patch::to_string((g[y * w + x].n) ? " " : "#") + "O";
-			ln2 += patch::to_string((g[y * w + x].e) ? " " : "#") + patch::to_string((g[y * w + x].visited) ? " " : "#") + patch::to_string((g[y * w + x].w) ? " " : "#");
-			ln3 += "O" + patch::to_string((g[y * w + x].s) ? " " : "#") + "O";
+		for (int x = 0; x < g.w; x++){
+			tile_t t = get_tile(g, x, y);
+			ln1 += "O" + patch::to_string((t.n) ? " " : "#") + "O";
+			ln2 += patch::to_string((t.w) ? " " : "#") + patch::to_string((t.visited) ? " " : "#") + patch::to_string((t.e) ? " " : "#");
+			ln3 += "O" + patch::to_string((t.s) ? " " : "#") + "O";
 		}
-		std::cout << "A: " << ln1 << std::endl;
-		std::cout << "B: " << ln2 << std::endl;
-		std::cout << "C: " << ln3 << std::endl;
+		os << "A: " << ln1 << std::endl;
+		os << "B: " << ln2 << std::endl;
+		os << "C: " << ln3 << std::endl;
 	}
-	std::cout << "done." << std::endl;
+	os << "done." << std::endl;
 }
 
-void print_visited(tile_t * grid){
-	std::cout << "visited:" << std::endl;
-	for (int y = 0; y < h; y++){
-		for (int x = 0; x < w; x++){
-			std::cout << grid[y * w + x].visited;
-		}
-		std::cout << std::endl;
+// run verify_maze and say what it found. returns whether the maze verified
+bool print_verify(const grid_t & g) {
+	verify_result_t r;
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	bool ok = verify_maze(g, &r);
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	std::cout << "verify: " << (ok ? "ok" : "FAILED") << " passages: " << r.edges
+		<< " of " << r.cells - 1 << " leaks: " << r.leaks << " reached: " << r.reached
+		<< " of " << r.cells << " ms: "
+		<< std::chrono::duration<double, std::milli>(t1 - t0).count() << std::endl;
+	return ok;
+}
+
+// time every backend on a size x size maze and print per cell throughput,
+// texture and whether the result verified
+void run_algo_bench(int size) {
+	std::cout << "algo,size,ms,ns_per_cell,dead_ends,verify" << std::endl;
+	rng_t rng;
+	rng_seed(rng, time(NULL));
+	for (int i = 0; i < n_maze_algos; i++) {
+		grid_t grid;
+		grid_init(grid, size, size);
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		maze_algos[i].fn(grid, rng, NULL, NULL);
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+
+		std::cout << maze_algos[i].name << "," << size << "x" << size << "," << ns / 1e6 << ","
+			<< ns / ((double) size * size) << "," << dead_end_ratio(grid) << ","
+			<< (verify_maze(grid) ? "ok" : "FAILED") << std::endl;
+
+		grid_free(grid);
 	}
-	std::cout << "done.";
 }
 
-int main(int argc, char *argv[]) {
-	srand(time(NULL)); // init random
-	
-	if (argc == 3) {
-		w = strtol(argv[1], NULL, 10);
-		h = strtol(argv[2], NULL, 10);
-		stack_size = w * h;
-	} 
+// time generate_maze on doubling sizes from 20x10 up to max_w x max_w and
+// print time per cell. if the generator is linear ns_per_cell stays flat.
+void run_bench(int max_w) {
+	std::cout << "size,cells,cycles,ms,ns_per_cell" << std::endl;
+	rng_t rng;
+	rng_seed(rng, time(NULL));
+	int bw = 20;
+	int bh = 10;
+	while (true) {
+		int w = bw;
+		int h = bh;
+		long long cells = (long long) w * h;
 
-	// create and init grid
-	tile_t * grid = new tile_t[w * h];
-	for (int i = 0; i < w * h; i++)
-		set_tile(grid[i], false, false, false, false, false);
+		grid_t grid;
+		grid_init(grid, w, h);
+		dir_stack_t stk;
+		dstk_init(stk);
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		long long cycle = generate_maze(grid, stk, rng_range(rng, w), rng_range(rng, h), rng);
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+		double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+
+		std::cout << w << "x" << h << "," << cells << "," << cycle << ","
+			<< ns / 1e6 << "," << ns / cells << std::endl;
 
-	// create and init stack
-	int stk_addr = 0;
-	point_t * stk = new point_t[stack_size];
-	for (int i = 0; i < stack_size; i++){
-		stk[i].x = 0;
-		stk[i].y = 0;
+		grid_free(grid);
+		dstk_free(stk);
+
+		if (bw >= max_w && bh >= max_w) break;
+		// grow the short side first so the last step is square
+		if (bh < bw) {
+			bh *= 2;
+		} else {
+			bw *= 2;
+		}
+		if (bw > max_w) bw = max_w;
+		if (bh > max_w) bh = max_w;
 	}
+}
 
-	// main algorithm
-	int cx = rand() % w;
-	int cy = rand() % h;
+// dfs generation and a corner to corner bfs under each layout, for widths
+// from 1k up to max_w with the height picked to keep about cells cells.
+// the same seed gives the same maze in every layout
+void run_layout_bench(int max_w, long long cells) {
+	std::cout << "layout,size,gen_ns_per_cell,solve_ns_per_cell,path" << std::endl;
+	for (int lw = 1024; lw <= max_w; lw *= 2) {
+		int lh = (int) std::max(1LL, cells / lw);
+		for (int layout = 0; layout < 3; layout++) {
+			grid_t grid;
+			grid_init(grid, lw, lh, layout);
+			rng_t rng;
+			rng_seed(rng, lw);
 
-	// push current onto stack
-	//stk_addr++; // leave {-1, -1} as first element
-	stk[stk_addr++] = {cx, cy};
+			std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+			algo_dfs(grid, rng, NULL);
+			std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+			long long path = bfs_distance(grid, 0, 0, lw - 1, lh - 1);
+			std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
 
-	int cycle = 1;
-	while (true) {
-		//std::cout << "cycle " << cycle << "\n";
-		// set current cell as visited
-		//grid[cy * w + cx].visited = true;
-
-		// get unvisited neighbors
-		int n[4] = {0, 0, 0, 0};
-		if (cx + 1 < w) {
-			n[0] = !grid[cy * w + (cx + 1)].visited; // east
+			double n = (double) lw * lh;
+			std::cout << layout_names[layout] << "," << lw << "x" << lh << ","
+				<< std::chrono::duration<double, std::nano>(t1 - t0).count() / n << ","
+				<< std::chrono::duration<double, std::nano>(t2 - t1).count() / n << ","
+				<< path << std::endl;
+			grid_free(grid);
 		}
-		if (cx - 1 >= 0) {
-			n[1] = !grid[cy * w + (cx - 1)].visited; // west
+	}
+}
+
+// solve g from the top left to the bottom right corner and say how it went
+void print_solve(const grid_t & g, int algo) {
+	solver_t s;
+	solver_init(s, (long long) g.w * g.h);
+	solve_result_t res;
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	solve_maze(s, g, 0, 0, g.w - 1, g.h - 1, algo, res);
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	std::cout << "solve: " << solve_names[algo] << " path: " << res.length
+		<< " expanded: " << res.expanded << " ms: "
+		<< std::chrono::duration<double, std::milli>(t1 - t0).count() << std::endl;
+	solver_free(s);
+}
+
+// corner to corner solves of square dfs mazes from 1k up to max_w with
+// every search, sharing one solver_t sized for the largest maze
+void run_solve_bench(int max_w) {
+	std::cout << "algo,size,ms,ns_per_cell,expanded,expanded_pct,path" << std::endl;
+	solver_t s;
+	solver_init(s, (long long) max_w * max_w);
+	solve_result_t res;
+	for (int sw = 1024; sw <= max_w; sw *= 2) {
+		grid_t grid;
+		grid_init(grid, sw, sw);
+		rng_t rng;
+		rng_seed(rng, sw);
+		algo_dfs(grid, rng, NULL);
+		double n = (double) sw * sw;
+		for (int algo = 0; algo < 3; algo++) {
+			std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+			solve_maze(s, grid, 0, 0, sw - 1, sw - 1, algo, res);
+			std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+			double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+			std::cout << solve_names[algo] << "," << sw << "x" << sw << "," << ns / 1e6 << ","
+				<< ns / n << "," << res.expanded << "," << 100.0 * res.expanded / n << ","
+				<< res.length << std::endl;
 		}
-		if (cy + 1 < h) {
-			n[2] = !grid[(cy + 1) * w + cx].visited; // south
+		grid_free(grid);
+	}
+	solver_free(s);
+}
+
+// build a dist_index_t for a size x size dfs maze, then time distance and
+// path queries between random cells. the first hundred distances are
+// checked against bfs
+void run_dist_bench(int size, long long queries) {
+	grid_t grid;
+	grid_init(grid, size, size);
+	rng_t rng;
+	rng_seed(rng, size);
+	algo_dfs(grid, rng, NULL);
+
+	dist_index_t di;
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	if (!dist_index_build(di, grid)) {
+		std::cout << "too big to index" << std::endl;
+		grid_free(grid);
+		return;
+	}
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	std::cout << "index: " << size << "x" << size << " ms: " << ms_between(t0, t1) << std::endl;
+
+	// draw the pairs up front so only the queries are timed
+	std::vector<int> q(4 * queries);
+	for (long long i = 0; i < queries; i++) {
+		q[4 * i] = rng_range(rng, size);
+		q[4 * i + 1] = rng_range(rng, size);
+		q[4 * i + 2] = rng_range(rng, size);
+		q[4 * i + 3] = rng_range(rng, size);
+	}
+
+	long long sum = 0;
+	t0 = std::chrono::steady_clock::now();
+	for (long long i = 0; i < queries; i++)
+		sum += maze_distance(di, q[4 * i], q[4 * i + 1], q[4 * i + 2], q[4 * i + 3]);
+	t1 = std::chrono::steady_clock::now();
+	double ms = ms_between(t0, t1);
+	std::cout << "distance: " << queries << " queries ms: " << ms << " Mq/s: " << queries / ms / 1e3
+		<< " mean: " << (double) sum / queries << std::endl;
+
+	std::vector<long long> out(queries);
+	t0 = std::chrono::steady_clock::now();
+	maze_distances(di, &q[0], queries, &out[0]);
+	t1 = std::chrono::steady_clock::now();
+	ms = ms_between(t0, t1);
+	long long batch_sum = 0;
+	for (long long i = 0; i < queries; i++) batch_sum += out[i];
+	std::cout << "batched: " << queries << " queries ms: " << ms << " Mq/s: " << queries / ms / 1e3
+		<< (batch_sum == sum ? "" : " MISMATCH") << std::endl;
+
+	// a path costs a step per cell on it, and in a dfs maze even close
+	// cells tend to be far apart, so these get their own smaller count
+	long long path_queries = std::min(queries, 1000LL);
+	std::vector<point_t> path;
+	long long steps = 0;
+	t0 = std::chrono::steady_clock::now();
+	for (long long i = 0; i < path_queries; i++)
+		steps += maze_path(di, q[4 * i], q[4 * i + 1], q[4 * i + 2], q[4 * i + 3], path);
+	t1 = std::chrono::steady_clock::now();
+	ms = ms_between(t0, t1);
+	std::cout << "path: " << path_queries << " queries ms: " << ms << " ns_per_step: "
+		<< ms * 1e6 / steps << " mean: " << (double) steps / path_queries << std::endl;
+
+	solver_t s;
+	solver_init(s, (long long) size * size);
+	solve_result_t res;
+	long long bad = 0;
+	long long checks = std::min(queries, 100LL);
+	for (long long i = 0; i < checks; i++) {
+		solve_maze(s, grid, q[4 * i], q[4 * i + 1], q[4 * i + 2], q[4 * i + 3], SOLVE_BIDI, res);
+		bad += res.length != maze_distance(di, q[4 * i], q[4 * i + 1], q[4 * i + 2], q[4 * i + 3]);
+	}
+	std::cout << "check: " << checks - bad << " of " << checks << " match bfs" << std::endl;
+
+	solver_free(s);
+	dist_index_free(di);
+	grid_free(grid);
+}
+
+// contract a size x size maze from every generator and time random cell to
+// cell queries on the junction graph against bidirectional bfs on the cells
+void run_junction_bench(int size, int queries) {
+	std::cout << "algo,size,nodes_pct,edges,build_ms,bidi_us,junction_us,bidi_expanded,junction_expanded"
+		<< std::endl;
+	solver_t s;
+	solver_init(s, (long long) size * size);
+	solve_result_t res;
+	for (int a = 0; a < n_maze_algos; a++) {
+		grid_t grid;
+		grid_init(grid, size, size);
+		rng_t rng;
+		rng_seed(rng, size);
+		maze_algos[a].fn(grid, rng, NULL, NULL);
+
+		junction_graph_t jg;
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		junction_build(jg, grid);
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+		double build_ms = ms_between(t0, t1);
+		junction_search_t js;
+		junction_search_init(js, jg);
+
+		double bidi_ms = 0;
+		double junction_ms = 0;
+		long long bidi_expanded = 0;
+		long long junction_expanded = 0;
+		long long bad = 0;
+		for (int i = 0; i < queries; i++) {
+			int sx = rng_range(rng, size);
+			int sy = rng_range(rng, size);
+			int tx = rng_range(rng, size);
+			int ty = rng_range(rng, size);
+			t0 = std::chrono::steady_clock::now();
+			solve_maze(s, grid, sx, sy, tx, ty, SOLVE_BIDI, res);
+			t1 = std::chrono::steady_clock::now();
+			bidi_ms += ms_between(t0, t1);
+			bidi_expanded += res.expanded;
+			long long length = res.length;
+
+			t0 = std::chrono::steady_clock::now();
+			junction_solve(js, jg, grid, sx, sy, tx, ty, res);
+			t1 = std::chrono::steady_clock::now();
+			junction_ms += ms_between(t0, t1);
+			junction_expanded += res.expanded;
+			bad += res.length != length;
 		}
-		if (cy - 1 >= 0) {
-			n[3] = !grid[(cy - 1) * w + cx].visited; // north
+
+		std::cout << maze_algos[a].name << "," << size << "x" << size << ","
+			<< 100.0 * jg.nodes / ((double) size * size) << "," << jg.edges / 2 << "," << build_ms << ","
+			<< bidi_ms * 1e3 / queries << "," << junction_ms * 1e3 / queries << ","
+			<< bidi_expanded / queries << "," << junction_expanded / queries
+			<< (bad == 0 ? "" : ",MISMATCH") << std::endl;
+
+		junction_search_free(js);
+		junction_free(jg);
+		grid_free(grid);
+	}
+	solver_free(s);
+}
+
+// render a size x size maze with the old ostream path and with the buffered
+// renderer in both formats, all into /dev/null, and print the times
+void run_render_bench(int size) {
+	rng_t rng;
+	rng_seed(rng, time(NULL));
+	grid_t grid;
+	grid_init(grid, size, size);
+	algo_dfs(grid, rng, NULL);
+
+	std::cout << "render,size,ms" << std::endl;
+	for (int k = 0; k < 3; k++) {
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		if (k == 0) {
+			std::ofstream os("/dev/null");
+			print_maze_ostream(grid, os);
+		} else {
+			FILE * f = fopen("/dev/null", "wb");
+			render_maze(grid, f, (k == 1) ? RENDER_ABC : RENDER_COMPACT);
+			fclose(f);
 		}
+		std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+		const char * name[3] = {"ostream", "buffered", "compact"};
+		std::cout << name[k] << "," << size << "x" << size << ","
+			<< std::chrono::duration<double, std::milli>(t1 - t0).count() << std::endl;
+	}
 
-		if (n[0] + n[1] + n[2] + n[3] > 0) { // if 1 or more unvisited neighbors
-			// choose random neighbor
-			int idx = -1;
-			while (idx < 0 || n[idx] == 0) {
-				idx = rand() % 4;
-			}
+	grid_free(grid);
+}
+
+int main(int argc, char *argv[]) {
+	uint64_t seed = time(NULL); // init random
+	int w = 20;
+	int h = 10;
 
-			// grid[cy * w + cx].visited = true;
-
-			// connect current to neighbors and set neighbor as current cell
-			switch (idx){
-			case 0:
-				grid[(cx + 1) + cy * w].e = true;
-				grid[cx + cy * w].w = true;
-				cx++;
-				break;
-			case 1:
-				grid[(cx - 1) + cy * w].w = true;
-				grid[cx + cy * w].e = true;
-				cx--;
-				break;
-			case 2:
-				grid[cx + (cy + 1) * w].n = true;
-				grid[cx + cy * w].s = true;
-				cy++;
-				break;
-			case 3:
-				grid[cx + (cy - 1) * w].s = true;
-				grid[cx + cy * w].n = true;
-				cy--;
-				break;
+	// usage: mazetest [w h] [--seed n] [--algo name] [--bench [max_w]]
+	//                 [--bench-algos [size]] [--bench-render [size]] [--stream]
+	//                 [--threads n [--tile size]] [--compact] [--quiet] [--verify]
+	//                 [--bmp file [--cell px] [--wall px]] [--save file] [--load file]
+	//                 [--count n [--threads n] [--lanes]] [--stats file|- [--perf]]
+	//                 [--world x y [--chunk size] [--cache chunks]]
+	//                 [--layout rows|tiled|morton] [--bench-layout [max_w [cells]]]
+	//                 [--solve bfs|astar|bidi] [--bench-solve [max_w]]
+	//                 [--bench-dist [size [queries]]] [--bench-junction [size [queries]]]
+	int pos = 0;
+	const maze_algo_t * algo = &maze_algos[0];
+	long long rows = h;
+	bool stream = false;
+	bool quiet = false;
+	bool verify = false;
+	int solve = -1;
+	int format = RENDER_ABC;
+	const char * bmp = NULL;
+	const char * save = NULL;
+	const char * load = NULL;
+	const char * stats_fn = NULL;
+	bool perf = false;
+	bool world = false;
+	long long world_x = 0;
+	long long world_y = 0;
+	int chunk = 64;
+	int layout = LAYOUT_ROWS;
+	int cache = 64;
+	int cell_px = 3;
+	int wall_px = 1;
+	int n_threads = 0;
+	long long count = 0;
+	bool lanes = false;
+	int tile = 256;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--stream") == 0) {
+			stream = true;
+		} else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+			seed = strtoull(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--bmp") == 0 && i + 1 < argc) {
+			bmp = argv[++i];
+		} else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+			save = argv[++i];
+		} else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+			load = argv[++i];
+		} else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+			stats_fn = argv[++i];
+		} else if (strcmp(argv[i], "--world") == 0 && i + 2 < argc) {
+			world = true;
+			world_x = strtoll(argv[++i], NULL, 10);
+			world_y = strtoll(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) {
+			chunk = strtol(argv[++i], NULL, 10);
+			if (chunk < 1) {
+				std::cout << "--chunk takes at least 1" << std::endl;
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+			cache = strtol(argv[++i], NULL, 10);
+			if (cache < 1) {
+				std::cout << "--cache takes at least 1" << std::endl;
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--layout") == 0 && i + 1 < argc) {
+			i++;
+			layout = -1;
+			for (int j = 0; j < 3; j++) {
+				if (strcmp(argv[i], layout_names[j]) == 0) layout = j;
+			}
+			if (layout < 0) {
+				std::cout << "unknown layout " << argv[i] << ", have: rows tiled morton" << std::endl;
+				return 1;
 			}
+		} else if (strcmp(argv[i], "--solve") == 0 && i + 1 < argc) {
+			i++;
+			for (int j = 0; j < 3; j++) {
+				if (strcmp(argv[i], solve_names[j]) == 0) solve = j;
+			}
+			if (solve < 0) {
+				std::cout << "unknown solver " << argv[i] << ", have: bfs astar bidi" << std::endl;
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--bench-solve") == 0) {
+			int max_w = 16384;
+			if (i + 1 < argc) max_w = strtol(argv[i + 1], NULL, 10);
+			run_solve_bench(max_w);
+			return 0;
+		} else if (strcmp(argv[i], "--bench-dist") == 0) {
+			int size = 4096;
+			long long queries = 10000000;
+			if (i + 1 < argc) size = strtol(argv[i + 1], NULL, 10);
+			if (i + 2 < argc) queries = strtoll(argv[i + 2], NULL, 10);
+			run_dist_bench(size, queries);
+			return 0;
+		} else if (strcmp(argv[i], "--bench-junction") == 0) {
+			int size = 2048;
+			int queries = 100;
+			if (i + 1 < argc) size = strtol(argv[i + 1], NULL, 10);
+			if (i + 2 < argc) queries = strtol(argv[i + 2], NULL, 10);
+			run_junction_bench(size, queries);
+			return 0;
+		} else if (strcmp(argv[i], "--bench-layout") == 0) {
+			int max_w = 65536;
+			long long cells = 1 << 24;
+			if (i + 1 < argc) max_w = strtol(argv[i + 1], NULL, 10);
+			if (i + 2 < argc) cells = strtoll(argv[i + 2], NULL, 10);
+			run_layout_bench(max_w, cells);
+			return 0;
+		} else if (strcmp(argv[i], "--perf") == 0) {
+			perf = true;
+		} else if (strcmp(argv[i], "--cell") == 0 && i + 1 < argc) {
+			cell_px = strtol(argv[++i], NULL, 10);
+			if (cell_px < 1) {
+				std::cout << "--cell takes at least 1" << std::endl;
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--wall") == 0 && i + 1 < argc) {
+			wall_px = strtol(argv[++i], NULL, 10);
+			if (wall_px < 0) {
+				std::cout << "--wall takes at least 0" << std::endl;
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--compact") == 0) {
+			format = RENDER_COMPACT;
+		} else if (strcmp(argv[i], "--quiet") == 0) {
+			quiet = true;
+		} else if (strcmp(argv[i], "--verify") == 0) {
+			verify = true;
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			n_threads = strtol(argv[++i], NULL, 10);
+			if (n_threads < 1) {
+				std::cout << "--threads takes at least 1" << std::endl;
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+			count = strtoll(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "--lanes") == 0) {
+			lanes = true;
+		} else if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc) {
+			tile = strtol(argv[++i], NULL, 10);
+			if (tile < 1) {
+				std::cout << "--tile takes at least 1" << std::endl;
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--algo") == 0 && i + 1 < argc) {
+			algo = find_algo(argv[++i]);
+			if (algo == NULL) {
+				std::cout << "unknown algorithm " << argv[i] << ", have:";
+				for (int j = 0; j < n_maze_algos; j++)
+					std::cout << " " << maze_algos[j].name;
+				std::cout << std::endl;
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--bench-algos") == 0) {
+			int size = 1024;
+			if (i + 1 < argc) size = strtol(argv[i + 1], NULL, 10);
+			run_algo_bench(size);
+			return 0;
+		} else if (strcmp(argv[i], "--bench-render") == 0) {
+			int size = 1000;
+			if (i + 1 < argc) size = strtol(argv[i + 1], NULL, 10);
+			run_render_bench(size);
+			return 0;
+		} else if (strcmp(argv[i], "--bench") == 0) {
+			int max_w = 16384;
+			if (i + 1 < argc) max_w = strtol(argv[i + 1], NULL, 10);
+			run_bench(max_w);
+			return 0;
+		} else if (pos == 0) {
+			w = strtol(argv[i], NULL, 10);
+			pos++;
+		} else if (pos == 1) {
+			rows = strtoll(argv[i], NULL, 10);
+			h = (int) rows;
+			pos++;
+		}
+	}
 
-			grid[cy * w + cx].visited = true;
+	if (w < 1 || rows < 1 || (!stream && rows > INT_MAX)) {
+		std::cout << "width and height take at least 1";
+		if (!stream) std::cout << " and at most " << INT_MAX;
+		std::cout << std::endl;
+		return 1;
+	}
 
-			// push current cell to stack
-			if (stk_addr + 1 < stack_size) {
-				stk[stk_addr++] = {cx, cy};
-			} else {
-				std::cout << "failed to push to stack!" << std::endl;
-				std::cout << "    " << stk_addr + 1 << " >= " << stack_size << std::endl;
-			}
-			
-		} else { // else
-			// pop stack into current cell
-			point_t p = stk[stk_addr--];
-			//std::cout << "reading from " << stk_addr + 1 << " found " << p.x << " , " << p.y << std::endl;
-			cx = p.x;
-			cy = p.y;
+	if (load != NULL) {
+		// render a saved maze without generating anything
+		maze_map_t m;
+		if (!load_maze(m, load)) {
+			std::cout << "can't load " << load << std::endl;
+			return 1;
 		}
+		std::cout << "loaded " << m.grid.w << "x" << m.grid.h << " seed: " << m.hdr->seed
+			<< " algo: " << m.hdr->algo << std::endl;
+		bool verified = !verify || print_verify(m.grid);
+		if (solve >= 0) print_solve(m.grid, solve);
+		if (bmp != NULL && !render_bmp(m.grid, bmp, cell_px, wall_px))
+			std::cout << "can't open " << bmp << std::endl;
+		if (!quiet) print_maze(m.grid, format);
+		unload_maze(m);
+		return verified ? 0 : 1;
+	}
 
-		// if all cells visited exit
-		bool flag = true;
-		for (int i = 0; i < w * h; i++){
-			if (!grid[i].visited) {
-				flag = false;
-				break;
-			}
+	// same seed, same maze. report it so any run can be repeated
+	rng_t rng;
+	rng_seed(rng, seed);
+	std::cerr << "seed: " << seed << std::endl;
+
+	if (world) {
+		// show a w x h window of the infinite world at (world_x, world_y)
+		world_t wd;
+		if (!world_init(wd, seed, chunk, cache)) return 1;
+		grid_t win;
+		grid_init(win, w, h);
+		world_window(wd, world_x, world_y, win);
+		std::cerr << "world chunks: " << chunk << "x" << chunk << " cache: " << cache
+			<< " hits: " << wd.hits << " misses: " << wd.misses << std::endl;
+		if (bmp != NULL && !render_bmp(win, bmp, cell_px, wall_px))
+			std::cout << "can't open " << bmp << std::endl;
+		if (!quiet) print_maze(win, format);
+		grid_free(win);
+		world_free(wd);
+		return 0;
+	}
+
+	if (count > 0) {
+		// many mazes per process: --threads sizes the pool, mazes go to
+		// stdout one after another unless --quiet
+		int pool = n_threads;
+		if (pool <= 0) pool = std::max(1u, std::thread::hardware_concurrency());
+		if (lanes && (w < 1 || w > LANE_MAX_SIDE || h < 1 || h > LANE_MAX_SIDE)) {
+			std::cout << "--lanes takes mazes of 1 to " << LANE_MAX_SIDE << " a side" << std::endl;
+			return 1;
 		}
+		if (lanes && algo->fn != algo_dfs) {
+			std::cout << "--lanes only carves dfs mazes, not " << algo->name << std::endl;
+			return 1;
+		}
+		run_batch(w, h, count, pool, seed, algo, format, quiet ? NULL : stdout, lanes);
+		return 0;
+	}
 
-		if (flag) {
-			break;
+	if (stream && bmp != NULL) {
+		// rows go straight into the image as they are made
+		bmp_maze_t bm;
+		if (!bmp_maze_begin(bm, bmp, w, rows, cell_px, wall_px)) {
+			std::cout << "can't open " << bmp << " or too big for a bitmap" << std::endl;
+			return 1;
 		}
+		generate_maze_stream(w, rows, bmp_sink, &bm, rng);
+		return 0;
+	}
+
+	if (stream) {
+		// rows go straight to stdout as they are made, nothing w * h is kept
+		ascii_sink_t st;
+		st.rows = rows;
+		st.format = format;
+		st.north = new uint64_t[(w + 63) / 64];
+		ob_init(st.ob, stdout, 1 << 20);
+		generate_maze_stream(w, rows, ascii_sink, &st, rng);
+		ob_free(st.ob);
+		delete[] st.north;
+		return 0;
+	}
+	gen_stats_t stats;
+	stats_clear(stats);
+	hw_counters_t hw;
+	if (perf) hw_open(hw);
 
-		/*std::cout << "=========== cycle " << cycle << " ==============" << std::endl;
-		print_maze(grid);
-		std::cout << std::endl;*/
-		
-		cycle++;
+	// create and init grid
+	std::chrono::steady_clock::time_point t_init = std::chrono::steady_clock::now();
+	MazeGenerator gen(w, h, seed);
+	gen.set_algo(algo->name);
+	gen.set_layout(layout);
+	grid_t grid;
+	if (n_threads > 0) {
+		grid_init(grid, w, h, layout);
+	} else {
+		gen.reserve();
+	}
+
+	// main algorithm
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	if (perf) hw_start(hw);
+	if (n_threads > 0) {
+		generate_maze_parallel(grid, tile, n_threads, seed, &stats);
+	} else {
+		grid = gen.generate();
+		stats = gen.stats();
 	}
+	if (perf) hw_stop(hw);
+	std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
 
 	std::cout << std::endl;
 	std::cout << "done." << std::endl;
 
-	std::cout << grid[3 * w + 4].visited << std::endl;
+	if (n_threads > 0) {
+		double ms = ms_between(t0, t1);
+		std::cout << "threads: " << n_threads << " tile: " << tile << " ms: " << ms
+			<< " Mcells/s: " << (double) w * h / ms / 1e3 << std::endl;
+	}
+	// a failed verify is the exit status, so scripts can check mazes
+	bool verified = !(verify || n_threads > 0) || print_verify(grid);
+	if (solve >= 0) print_solve(grid, solve);
+
+	// saving is file io, not rendering, so it stays out of the render phase
+	if (save != NULL && !save_maze(grid, save, seed, (n_threads > 0) ? "parallel" : algo->name))
+		std::cout << "can't write " << save << std::endl;
 
-	print_maze(grid);
-	print_visited(grid);
+	std::chrono::steady_clock::time_point t_render = std::chrono::steady_clock::now();
+	if (bmp != NULL && !render_bmp(grid, bmp, cell_px, wall_px))
+		std::cout << "can't open " << bmp << std::endl;
+
+	if (!quiet) {
+		print_maze(grid, format);
+		if (format == RENDER_ABC) print_visited(grid);
+	}
+	std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+
+	if (stats_fn != NULL) {
+		FILE * f = (strcmp(stats_fn, "-") == 0) ? stderr : fopen(stats_fn, "a");
+		if (f == NULL) {
+			std::cout << "can't write " << stats_fn << std::endl;
+		} else {
+			write_stats_json(f, w, h, (n_threads > 0) ? "parallel" : algo->name, seed, n_threads,
+				stats, ms_between(t_init, t0), ms_between(t0, t1), ms_between(t_render, t2),
+				perf ? &hw : NULL);
+			if (f != stderr) fclose(f);
+		}
+	}
+	if (perf) hw_close(hw);
 
-	// cleanup memory
-	delete[] grid;
-	delete[] stk;
+	// cleanup memory, the generator's grid goes with its arena
+	if (n_threads > 0) grid_free(grid);
 
 	// leave
-	return true;
+	return verified ? 0 : 1;
 }